@@ -1,99 +1,262 @@
 #include "beat_detection.h"
 
-#include "driver/i2s.h"
+#include <atomic>
+#include <math.h>
 
-#define FFT_SQRT_APPROXIMATION
-#define FFT_SPEED_OVER_PRECISION
-#include <arduinoFFT.h>
-
-#include "timing.h"
+#include "decimator.h"
+#include "fixed_fft.h"
+#include "interface.h"
+#include "real_fft.h"
+#include "sliding_dft.h"
+#include "spectral_flux.h"
+#include "tempo_tracker.h"
 #include "profiling.h"
 
 #define BEAT_DEBOUNCE_DURATION_MS 200
+// The tempo estimate loses its confidence once no beat has been detected for this long
+#define TEMPO_HOLD_DURATION_MS 2000
 #define MAX_BASS_FREQUENCY_HZ 140.0f
+// Sliding DFT stand-in for the major peak being bass, see DetectBeat()
+#define PEAK_IS_BASS_MIN_ENERGY_FRACTION 0.3f
+#define LAST_BASS_BIN ((uint32_t)(MAX_BASS_FREQUENCY_HZ * FFT_BUFFER_LENGTH / ANALYSIS_FREQUENCY_HZ))
+// Mic samples per update and per window that the band coefficients and minimums were tuned with
+#define BAND_TUNING_WINDOW_LENGTH 1024
+
+static_assert(FFT_HOP_LENGTH % AUDIO_DECIMATION_FACTOR == 0, "AUDIO_DECIMATION_FACTOR must divide FFT_HOP_LENGTH");
+static_assert(FFT_BUFFER_LENGTH % ANALYSIS_HOP_LENGTH == 0, "ANALYSIS_HOP_LENGTH must divide FFT_BUFFER_LENGTH");
+
+#if BEAT_DETECTOR == BEAT_DETECTOR_SPECTRAL_FLUX
+static_assert(BEAT_DETECTION_BACKEND == BEAT_DETECTION_BACKEND_FFT, "Spectral flux detector needs the float FFT's full power spectrum");
+#endif
+
+#if BEAT_DETECTION_BACKEND == BEAT_DETECTION_BACKEND_FIXED_FFT
+// The decimator filters in float, which would let the analysed samples differ between targets
+static_assert(AUDIO_DECIMATION_FACTOR == 1, "Fixed point backend does not support decimation");
+static_assert(BAND_TUNING_WINDOW_LENGTH % FFT_HOP_LENGTH == 0, "FFT_HOP_LENGTH must divide BAND_TUNING_WINDOW_LENGTH");
+
+// Band magnitudes are fixed FFT bin magnitudes, 2^FIXED_FFT_SCALE_SHIFT smaller than the float ones,
+// and coefficients are Q16 so the band maths stays in integers too
+typedef int64_t bandMagnitude_t;
+typedef int32_t bandCoeff_t;
+#define BAND_COEFF_SHIFT 16
+#define BAND_COEFF(value) ((bandCoeff_t)((value) * (1 << BAND_COEFF_SHIFT) + 0.5))
+#define BAND_MAGNITUDE(value) ((bandMagnitude_t)((value) / (1 << FIXED_FFT_SCALE_SHIFT)))
+#else
+typedef float bandMagnitude_t;
+typedef float bandCoeff_t;
+#define BAND_COEFF(value) (value)
+#define BAND_MAGNITUDE(value) (value)
+#endif
 
 unsigned long lastBeatTime_ms = 0;
 bool isBeatDetected = false;
 
+// Audio side time of the last detection, for debouncing
+static int64_t lastDetectedBeatTime_ms = 0;
+// When the latest hop finished being captured, every audio side time is measured on this
+static int64_t hopCaptureTime_ms = 0;
+
+static tempoEstimate_t tempoEstimate = {};
+// Set by the render task when the controller sends a new beat length
+static std::atomic<uint16_t> controllerBeatLength_ms{0};
+
 typedef struct freqBandData_t
 {
-    float averageMagnitude;
-    float currentMagnitude;
+    bandMagnitude_t averageMagnitude;
+    bandMagnitude_t currentMagnitude;
     uint32_t lowerBinIndex;
     uint32_t upperBinIndex;
-    float beatDetectThresholdCoeff;
-    float leakyAverageCoeff;
-    float minMagnitude;
+    bandCoeff_t beatDetectThresholdCoeff;
+    bandCoeff_t leakyAverageCoeff;
+    bandMagnitude_t minMagnitude;
 } freqBandData_s;
 
-static freqBandData_t bassFreqData{
+// Bands as tuned, for one update per BAND_TUNING_WINDOW_LENGTH samples. BeatDetectionInit()
+// derives the bands used at the actual hop and window length from these.
+static const freqBandData_t bassFreqTuning{
     .averageMagnitude = 0,
     .currentMagnitude = 0,
-    .lowerBinIndex = 1,
-    .upperBinIndex = 2,
-    .beatDetectThresholdCoeff = 1.4,
-    .leakyAverageCoeff = 0.125,
-    .minMagnitude = 100000000
+    .lowerBinIndex = BASS_BAND_LOWER_BIN,
+    .upperBinIndex = BASS_BAND_UPPER_BIN,
+    .beatDetectThresholdCoeff = BAND_COEFF(1.4),
+    .leakyAverageCoeff = BAND_COEFF(0.125),
+    .minMagnitude = BAND_MAGNITUDE(100000000)
 };
 
-static freqBandData_t midFreqData{
+static const freqBandData_t midFreqTuning{
     .averageMagnitude = 0,
     .currentMagnitude = 0,
-    .lowerBinIndex = 3,
-    .upperBinIndex = 3,
-    .beatDetectThresholdCoeff = 1.3,
-    .leakyAverageCoeff = 0.125,
-    .minMagnitude = 100000000
+    .lowerBinIndex = MID_BAND_LOWER_BIN,
+    .upperBinIndex = MID_BAND_UPPER_BIN,
+    .beatDetectThresholdCoeff = BAND_COEFF(1.3),
+    .leakyAverageCoeff = BAND_COEFF(0.125),
+    .minMagnitude = BAND_MAGNITUDE(100000000)
 };
 
-float vImag[FFT_BUFFER_LENGTH] = {0};
-float vReal[FFT_BUFFER_LENGTH] = {0};
-ArduinoFFT<float> FFT = ArduinoFFT<float>(vReal, vImag, FFT_BUFFER_LENGTH, SAMPLING_FREQUENCY_HZ, true);
+static freqBandData_t bassFreqData;
+static freqBandData_t midFreqData;
+
+// Latest FFT_BUFFER_LENGTH samples, oldest at sampleRingIndex, and their running sum for DC removal
+static int32_t sampleRing[FFT_BUFFER_LENGTH] = {0};
+static uint32_t sampleRingIndex = 0;
+static int64_t sampleRingSum = 0;
+
+#if BEAT_DETECTION_BACKEND == BEAT_DETECTION_BACKEND_FFT
+// Holds the windowed samples going into the FFT, then the power of each bin coming out
+float fftBuffer[FFT_BUFFER_LENGTH] = {0};
+#elif BEAT_DETECTION_BACKEND == BEAT_DETECTION_BACKEND_SLIDING_DFT
+// Power of the bins the frequency bands read, the rest of the spectrum is never computed
+float fftBuffer[SLIDING_DFT_LAST_BIN] = {0};
+#elif BEAT_DETECTION_BACKEND == BEAT_DETECTION_BACKEND_FIXED_FFT
+// Holds the windowed samples going into the FFT, then the packed bins coming out
+int32_t fftBuffer[FFT_BUFFER_LENGTH] = {0};
+#endif
 
 static void AnalyzeFrequencyBand(freqBandData_t *);
+#if BEAT_DETECTOR == BEAT_DETECTOR_BAND_THRESHOLD
+static bool IsBandThresholdOnset(bool isNoRecentBeat, float *strength);
+#endif
 static inline bool IsMagAboveThreshold(freqBandData_t *);
 static inline float ProportionOfMagAboveAvg(freqBandData_t *);
-static void PopulateRealAndImag(int32_t rawMicSamples[FFT_BUFFER_LENGTH]);
+static float OnsetStrength(freqBandData_t *, bandMagnitude_t previousMagnitude);
+static inline bandMagnitude_t ScaleByCoeff(bandMagnitude_t magnitude, bandCoeff_t coeff);
+static void PushHopToSampleRing(int32_t rawMicSamples[FFT_HOP_LENGTH]);
+static void InitFrequencyBand(freqBandData_t *freqBand, const freqBandData_t *tuning);
+static bandCoeff_t LeakyAverageCoeffPerHop(bandCoeff_t coeffPerWindow);
+static bandMagnitude_t MinMagnitudeForWindow(bandMagnitude_t tunedMinMagnitude);
+
+void BeatDetectionInit()
+{
+    controllerBeatLength_ms.store(radioData.beatLength_ms, std::memory_order_relaxed);
+#if BEAT_DETECTION_BACKEND == BEAT_DETECTION_BACKEND_FFT
+    RealFftInit();
+#elif BEAT_DETECTION_BACKEND == BEAT_DETECTION_BACKEND_SLIDING_DFT
+    static_assert(MID_BAND_UPPER_BIN < SLIDING_DFT_LAST_BIN, "Sliding DFT must track one bin above the highest band bin");
+    SlidingDftInit();
+#elif BEAT_DETECTION_BACKEND == BEAT_DETECTION_BACKEND_FIXED_FFT
+    FixedFftInit();
+#endif
+#if AUDIO_DECIMATION_FACTOR > 1
+    DecimatorInit();
+#endif
+    TempoTrackerInit();
+    InitFrequencyBand(&bassFreqData, &bassFreqTuning);
+    InitFrequencyBand(&midFreqData, &midFreqTuning);
+#if BEAT_DETECTOR == BEAT_DETECTOR_SPECTRAL_FLUX
+    // Same time constant as the band averages
+    SpectralFluxInit(bassFreqData.leakyAverageCoeff);
+#endif
 
+    // Start from silence so every run over the same audio finds the same beats
+    for (uint32_t i = 0; i < FFT_BUFFER_LENGTH; ++i)
+    {
+        sampleRing[i] = 0;
+    }
+    sampleRingIndex = 0;
+    sampleRingSum = 0;
+    lastDetectedBeatTime_ms = 0;
+    hopCaptureTime_ms = 0;
+    tempoEstimate = {};
+}
 
-void ComputeFFT(int32_t rawMicSamples[FFT_BUFFER_LENGTH])
+// Analyse the latest FFT_BUFFER_LENGTH samples once the next hop of samples is added
+// @param captureTime_us[in]    When the last sample of the hop was captured, see ReadMicData()
+void ComputeFFT(int32_t rawMicSamples[FFT_HOP_LENGTH], int64_t captureTime_us)
 {
-    PopulateRealAndImag(rawMicSamples);
-    FFT.dcRemoval();
-    FFT.windowing(FFT_WIN_TYP_HAMMING, FFT_FORWARD);
-    FFT.compute(FFTDirection::Forward);
-    FFT.complexToMagnitude();
+    TRACE_BEGIN(TraceStage::fft);
+    hopCaptureTime_ms = captureTime_us / 1000;
+    PushHopToSampleRing(rawMicSamples);
+#if BEAT_DETECTION_BACKEND == BEAT_DETECTION_BACKEND_FFT
+    RealFftLoadSamples(sampleRing, sampleRingIndex, sampleRingSum, fftBuffer);
+    RealFftComputePower(fftBuffer);
+#elif BEAT_DETECTION_BACKEND == BEAT_DETECTION_BACKEND_SLIDING_DFT
+    // Once per window the ring is in order, a good time to clear the sliding DFT's drift
+    if (sampleRingIndex == 0)
+    {
+        SlidingDftResync(sampleRing);
+    }
+    SlidingDftComputePower(fftBuffer);
+#elif BEAT_DETECTION_BACKEND == BEAT_DETECTION_BACKEND_FIXED_FFT
+    FixedFftLoadSamples(sampleRing, sampleRingIndex, sampleRingSum, fftBuffer);
+    FixedFftCompute(fftBuffer);
+#endif
+#if BEAT_DETECTOR == BEAT_DETECTOR_SPECTRAL_FLUX
+    SpectralFluxUpdate(fftBuffer);
+#endif
+    TRACE_END(TraceStage::fft);
 
+    TRACE_BEGIN(TraceStage::bands);
+    const bandMagnitude_t previousBassMagnitude = bassFreqData.currentMagnitude;
     AnalyzeFrequencyBand(&bassFreqData);
     AnalyzeFrequencyBand(&midFreqData);
+    TempoTrackerUpdate(OnsetStrength(&bassFreqData, previousBassMagnitude), hopCaptureTime_ms, controllerBeatLength_ms.load(std::memory_order_relaxed), &tempoEstimate);
+    TRACE_END(TraceStage::bands);
 }
 
 void AnalyzeFrequencyBand(freqBandData_t *freqBand)
 {
     // Calculate current magnitude by averaging bins in frequency range
     freqBand->currentMagnitude = 0;
-    for (int binIndex = freqBand->lowerBinIndex; binIndex <= freqBand->upperBinIndex; ++binIndex)
+    for (uint32_t binIndex = freqBand->lowerBinIndex; binIndex <= freqBand->upperBinIndex; ++binIndex)
     {
-        freqBand->currentMagnitude += vReal[binIndex];
+#if BEAT_DETECTION_BACKEND == BEAT_DETECTION_BACKEND_FIXED_FFT
+        freqBand->currentMagnitude += FixedFftBinMagnitude(fftBuffer, binIndex);
+#else
+        freqBand->currentMagnitude += sqrtf(fftBuffer[binIndex]);
+#endif
     }
     uint32_t numberOfBins = (1 + freqBand->upperBinIndex - freqBand->lowerBinIndex);
     freqBand->currentMagnitude /= numberOfBins;
 
     // Calulate leaky average
-    freqBand->averageMagnitude += (freqBand->currentMagnitude - freqBand->averageMagnitude) * (freqBand->leakyAverageCoeff);
+    freqBand->averageMagnitude += ScaleByCoeff(freqBand->currentMagnitude - freqBand->averageMagnitude, freqBand->leakyAverageCoeff);
+}
+
+// Return true and fill in beatEvent if the latest FFT frame holds a beat
+// @param beatEvent[out]    Timestamp and strength of the detected beat
+bool DetectBeat(beatEvent_t *beatEvent)
+{
+    const bool isNoRecentBeat = (hopCaptureTime_ms - lastDetectedBeatTime_ms) > (BEAT_DEBOUNCE_DURATION_MS);
+    float strength;
+#if BEAT_DETECTOR == BEAT_DETECTOR_SPECTRAL_FLUX
+    const bool isOnset = SpectralFluxIsOnset(&strength);
+#elif BEAT_DETECTOR == BEAT_DETECTOR_BAND_THRESHOLD
+    const bool isOnset = IsBandThresholdOnset(isNoRecentBeat, &strength);
+#endif
+    const bool isBeat = (isNoRecentBeat && isOnset);
+
+    if (isBeat)
+    {
+        lastDetectedBeatTime_ms = hopCaptureTime_ms;
+        beatEvent->timestamp_ms = lastDetectedBeatTime_ms;
+        beatEvent->bassProportionAboveAvg = strength;
+#ifdef PRINT_BIN_MAGNITUDES
+        PrintVector(fftBuffer, sizeof(fftBuffer) / sizeof(fftBuffer[0]), SCL_FREQUENCY);
+        delay(20000);
+#endif
+    }
+    return isBeat;
 }
 
-void DetectBeat()
+#if BEAT_DETECTOR == BEAT_DETECTOR_BAND_THRESHOLD
+// True if the bass and mid bands are both above their averages with the spectrum's peak in the bass
+// @param isNoRecentBeat[in]    Only read to print why a beat was not detected
+// @param strength[out]         Bass magnitude over its average
+static bool IsBandThresholdOnset(bool isNoRecentBeat, float *strength)
 {
     const bool isBassAboveAvg = IsMagAboveThreshold(&bassFreqData);
     const bool isMidAboveAvg = IsMagAboveThreshold(&midFreqData);
-    const bool isNoRecentBeat = (GetMillis() - lastBeatTime_ms) > (BEAT_DEBOUNCE_DURATION_MS);
-    const bool peakIsBass = (FFT.majorPeak() < MAX_BASS_FREQUENCY_HZ);
+#if BEAT_DETECTION_BACKEND == BEAT_DETECTION_BACKEND_FFT
+    const bool peakIsBass = (RealFftMajorPeak(fftBuffer, ANALYSIS_FREQUENCY_HZ) < MAX_BASS_FREQUENCY_HZ);
+#elif BEAT_DETECTION_BACKEND == BEAT_DETECTION_BACKEND_SLIDING_DFT
+    // Without the full spectrum there is no peak to find. If the bass bins hold a large
+    // enough share of all the energy in the window no other bin can be much stronger.
+    const bool peakIsBass = (SlidingDftEnergyFraction(LAST_BASS_BIN) > PEAK_IS_BASS_MIN_ENERGY_FRACTION);
+#elif BEAT_DETECTION_BACKEND == BEAT_DETECTION_BACKEND_FIXED_FFT
+    const bool peakIsBass = (FixedFftMajorPeakQ8(fftBuffer, ANALYSIS_FREQUENCY_HZ) < (int64_t)(MAX_BASS_FREQUENCY_HZ * 256));
+#endif
     const bool isAvgBassAboveMin = (bassFreqData.averageMagnitude > bassFreqData.minMagnitude);
-    const float proportionBassAboveAvg = ProportionOfMagAboveAvg(&bassFreqData);
-    const float proportionMidAboveAvg = ProportionOfMagAboveAvg(&midFreqData);
-
-    isBeatDetected = (isNoRecentBeat && isBassAboveAvg && peakIsBass && isAvgBassAboveMin && isMidAboveAvg);
+    *strength = ProportionOfMagAboveAvg(&bassFreqData);
 
 #ifdef PRINT_CURRENT_BASS_MAG
     Serial.println(bassFreqData.currentMagnitude);
@@ -114,38 +277,128 @@ void DetectBeat()
             Serial.println("isBassAboveAvg");
         }
     }
+#else
+    (void)isNoRecentBeat;
 #endif
+    return (isBassAboveAvg && peakIsBass && isAvgBassAboveMin && isMidAboveAvg);
+}
+#endif // BEAT_DETECTOR == BEAT_DETECTOR_BAND_THRESHOLD
 
-    if (isBeatDetected)
+// Latest tempo and predicted next beat, with no confidence while the detector hears no beats
+void GetTempoEstimate(tempoEstimate_t *estimate)
+{
+    *estimate = tempoEstimate;
+    if ((hopCaptureTime_ms - lastDetectedBeatTime_ms) > TEMPO_HOLD_DURATION_MS)
     {
-        lastBeatTime_ms = GetMillis();
-#ifdef PRINT_BIN_MAGNITUDES
-        PrintVector(vReal, NUMBER_OF_SAMPLES, SCL_FREQUENCY);
-        delay(20000);
-#endif
+        estimate->confidence = 0;
     }
 }
 
-static void PopulateRealAndImag(int32_t rawMicSamples[FFT_BUFFER_LENGTH])
+void SetBeatLength(uint16_t beatLength_ms)
+{
+    controllerBeatLength_ms.store(beatLength_ms, std::memory_order_relaxed);
+}
+
+static void PushHopToSampleRing(int32_t rawMicSamples[FFT_HOP_LENGTH])
 {
-    for (int i = 0; i < FFT_BUFFER_LENGTH; i++)
-    {
-        vReal[i] = (float)rawMicSamples[i];
 #ifdef OUTPUT_AUDIO
+    for (int i = 0; i < FFT_HOP_LENGTH; i++)
+    {
         Serial.print(rawMicSamples[i]);
+    }
+#endif
+#if AUDIO_DECIMATION_FACTOR > 1
+    int32_t hopSamples[ANALYSIS_HOP_LENGTH];
+    Decimate(rawMicSamples, FFT_HOP_LENGTH, hopSamples);
+#else
+    const int32_t *hopSamples = rawMicSamples;
 #endif
+
+#if BEAT_DETECTION_BACKEND == BEAT_DETECTION_BACKEND_SLIDING_DFT
+    SlidingDftUpdate(hopSamples, &sampleRing[sampleRingIndex], ANALYSIS_HOP_LENGTH);
+#endif
+    // The hop divides the ring so it never wraps within a hop
+    for (int i = 0; i < ANALYSIS_HOP_LENGTH; i++)
+    {
+        sampleRingSum += (int64_t)hopSamples[i] - sampleRing[sampleRingIndex + i];
+        sampleRing[sampleRingIndex + i] = hopSamples[i];
+    }
+    sampleRingIndex = (sampleRingIndex + ANALYSIS_HOP_LENGTH) % FFT_BUFFER_LENGTH;
+}
+
+static void InitFrequencyBand(freqBandData_t *freqBand, const freqBandData_t *tuning)
+{
+    *freqBand = *tuning;
+    freqBand->leakyAverageCoeff = LeakyAverageCoeffPerHop(tuning->leakyAverageCoeff);
+    freqBand->minMagnitude = MinMagnitudeForWindow(tuning->minMagnitude);
+}
+
+// The band coefficients are tuned for one update per BAND_TUNING_WINDOW_LENGTH mic samples,
+// scale them so the averages keep the same time constant when updated every hop
+static bandCoeff_t LeakyAverageCoeffPerHop(bandCoeff_t coeffPerWindow)
+{
+#if BEAT_DETECTION_BACKEND == BEAT_DETECTION_BACKEND_FIXED_FFT
+    // powf() may round differently between targets, so find the largest Q16 per hop
+    // retention whose power over a tuning window doesn't exceed the per window one
+    const int64_t one = 1 << BAND_COEFF_SHIFT;
+    const int64_t retainPerWindow = one - coeffPerWindow;
+    int64_t low = 0;
+    int64_t high = one;
+    while (low < high)
+    {
+        const int64_t mid = (low + high + 1) / 2;
+        int64_t retainOverWindow = one;
+        for (int hop = 0; hop < BAND_TUNING_WINDOW_LENGTH / FFT_HOP_LENGTH; hop++)
+        {
+            retainOverWindow = (retainOverWindow * mid) >> BAND_COEFF_SHIFT;
+        }
+        if (retainOverWindow <= retainPerWindow)
+        {
+            low = mid;
+        }
+        else
+        {
+            high = mid - 1;
+        }
     }
-    // The audio is only real data but the FFT outputs to vImag so it needs to be zeroed each time
-    memset(vImag, 0, sizeof(vImag));
-    EMIT_PROFILING_EVENT;
+    return (bandCoeff_t)(one - low);
+#else
+    return 1.0f - powf(1.0f - coeffPerWindow, (float)FFT_HOP_LENGTH / BAND_TUNING_WINDOW_LENGTH);
+#endif
+}
+
+// Bin magnitudes of a steady tone grow with the window length, so the minimums tuned
+// on a BAND_TUNING_WINDOW_LENGTH window scale with it
+static bandMagnitude_t MinMagnitudeForWindow(bandMagnitude_t tunedMinMagnitude)
+{
+    return tunedMinMagnitude * FFT_BUFFER_LENGTH / BAND_TUNING_WINDOW_LENGTH;
 }
 
 static inline bool IsMagAboveThreshold(freqBandData_t *freqBandData)
 {
-    return (freqBandData->currentMagnitude > (freqBandData->averageMagnitude * freqBandData->beatDetectThresholdCoeff));
+    return (freqBandData->currentMagnitude > ScaleByCoeff(freqBandData->averageMagnitude, freqBandData->beatDetectThresholdCoeff));
 }
 
 static inline float ProportionOfMagAboveAvg(freqBandData_t *freqBandData)
 {
-    return (freqBandData->currentMagnitude / freqBandData->averageMagnitude);
+    return ((float)freqBandData->currentMagnitude / freqBandData->averageMagnitude);
+}
+
+// Rise in the band's magnitude over the last hop relative to its average, 0 if it fell
+static float OnsetStrength(freqBandData_t *freqBandData, bandMagnitude_t previousMagnitude)
+{
+    if (freqBandData->currentMagnitude <= previousMagnitude || freqBandData->averageMagnitude <= 0)
+    {
+        return 0;
+    }
+    return ((float)(freqBandData->currentMagnitude - previousMagnitude) / freqBandData->averageMagnitude);
+}
+
+static inline bandMagnitude_t ScaleByCoeff(bandMagnitude_t magnitude, bandCoeff_t coeff)
+{
+#if BEAT_DETECTION_BACKEND == BEAT_DETECTION_BACKEND_FIXED_FFT
+    return (magnitude * coeff) >> BAND_COEFF_SHIFT;
+#else
+    return magnitude * coeff;
+#endif
 }
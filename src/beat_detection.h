@@ -1,15 +1,61 @@
 #ifndef BEAT_DETECTION_H
 #define BEAT_DETECTION_H
 
-#include "driver/i2s.h"
+#include <stdint.h>
 
 #define SAMPLING_FREQUENCY_HZ 48000
+// Mic samples are low pass filtered and decimated by this before analysis, 1 turns it off.
+// 16 with an FFT_BUFFER_LENGTH of 256 gives 11.7 Hz bins over an 85 ms window.
+#define AUDIO_DECIMATION_FACTOR 1
+#define ANALYSIS_FREQUENCY_HZ (SAMPLING_FREQUENCY_HZ / AUDIO_DECIMATION_FACTOR)
+// Analysis window, in samples at ANALYSIS_FREQUENCY_HZ
 #define FFT_BUFFER_LENGTH 1024
+// Mic samples read per analysis. Every hop the FFT is run over the latest FFT_BUFFER_LENGTH samples,
+// so a smaller hop detects beats sooner for more CPU. ANALYSIS_HOP_LENGTH must divide
+// FFT_BUFFER_LENGTH, which turns the overlap off when it is the hop.
+#define FFT_HOP_LENGTH 256
+#define ANALYSIS_HOP_LENGTH (FFT_HOP_LENGTH / AUDIO_DECIMATION_FACTOR)
 
+// Frequency bands the detector compares, as bins of the analysis window
+#define ANALYSIS_BIN(hz) ((uint32_t)((hz) * FFT_BUFFER_LENGTH / ANALYSIS_FREQUENCY_HZ + 0.5f))
+#define BASS_BAND_LOWER_BIN ANALYSIS_BIN(40.0f)
+#define BASS_BAND_UPPER_BIN ANALYSIS_BIN(100.0f)
+#define MID_BAND_LOWER_BIN ANALYSIS_BIN(120.0f)
+#define MID_BAND_UPPER_BIN ANALYSIS_BIN(160.0f)
+
+// Beat detection backends, pick one with BEAT_DETECTION_BACKEND
+#define BEAT_DETECTION_BACKEND_FFT 0         // Real FFT of the whole window every hop
+#define BEAT_DETECTION_BACKEND_SLIDING_DFT 1 // Sliding DFT of only the band bins, updated every sample
+#define BEAT_DETECTION_BACKEND_FIXED_FFT 2   // Integer only real FFT, identical beat decisions on every target
+#ifndef BEAT_DETECTION_BACKEND
+#define BEAT_DETECTION_BACKEND BEAT_DETECTION_BACKEND_FFT
+#endif
+
+// Beat detectors, pick one with BEAT_DETECTOR
+#define BEAT_DETECTOR_BAND_THRESHOLD 0 // Bass and mid band magnitudes above their averages, peak in the bass
+#define BEAT_DETECTOR_SPECTRAL_FLUX 1  // Rise in log power over log spaced bands, needs the float FFT backend
+#ifndef BEAT_DETECTOR
+#define BEAT_DETECTOR BEAT_DETECTOR_BAND_THRESHOLD
+#endif
+
+// See tempo_tracker.h
+struct tempoEstimate_t;
+
+typedef struct beatEvent_t
+{
+    int64_t timestamp_ms; // Capture time of the hop the beat was heard in
+    float bassProportionAboveAvg;
+} beatEvent_s;
+
+// Render side view of the beat events, updated once per frame from the beat event queue
 extern unsigned long lastBeatTime_ms;
 extern bool isBeatDetected;
 
-void ComputeFFT(int32_t rawMicSamples[FFT_BUFFER_LENGTH]);
-void DetectBeat();
+void BeatDetectionInit();
+void ComputeFFT(int32_t rawMicSamples[FFT_HOP_LENGTH], int64_t captureTime_us);
+bool DetectBeat(beatEvent_t *beatEvent);
+void GetTempoEstimate(tempoEstimate_t *estimate);
+// Controller beat length hint for the tempo tracker, safe to call from another task
+void SetBeatLength(uint16_t beatLength_ms);
 
 #endif // BEAT_DETECTION_H
@@ -0,0 +1,167 @@
+#include "compositor.h"
+
+typedef struct ledLayer_t
+{
+    ledCanvas_t canvas;
+    // Last frame of the effect this layer replaced
+    ledCanvas_t outgoing;
+    Effect effect;
+    // Left to fade, LAYER_CROSSFADE_MS while showing and 0 once hidden
+    uint16_t fade_ms;
+    uint16_t outgoingFade_ms;
+} ledLayer_s;
+
+// Bottom to top, see LedLayer
+static constexpr BlendMode layerModes[] = {
+    BlendMode::alpha, // ambient
+    BlendMode::max,   // beat
+    BlendMode::add,   // strobe
+};
+static_assert(sizeof(layerModes) / sizeof(layerModes[0]) == (uint32_t)LedLayer::layer_count, "Give every layer a blend mode");
+
+// About 3 kB, with 170 LEDs
+static ledLayer_t layers[(uint32_t)LedLayer::layer_count];
+
+static void BlendCanvas(const ledCanvas_t *canvas, BlendMode mode, uint8_t opacity, bool *isOutputBlack);
+static uint16_t FadeDown(uint16_t fade_ms, uint32_t dt_ms);
+static uint8_t FadeOpacity(uint16_t fade_ms);
+
+// The kernels run over the bytes of the frame with no branches inside the loop, so the
+// compiler can unroll them, or vectorise them where the target has SIMD. weight is the
+// opacity plus one, as in scale8(), so 255 leaves the source as it is.
+static_assert(sizeof(CRGB) == 3, "The blend kernels treat CRGB arrays as packed bytes");
+
+static void BlendAdd(uint8_t *__restrict out, const uint8_t *__restrict in, uint32_t length, uint16_t weight)
+{
+    for (uint32_t i = 0; i < length; ++i)
+    {
+        const uint16_t sum = out[i] + ((in[i] * weight) >> 8);
+        out[i] = (sum > 255) ? 255 : (uint8_t)sum;
+    }
+}
+
+static void BlendMax(uint8_t *__restrict out, const uint8_t *__restrict in, uint32_t length, uint16_t weight)
+{
+    for (uint32_t i = 0; i < length; ++i)
+    {
+        const uint8_t scaled = (uint8_t)((in[i] * weight) >> 8);
+        out[i] = (scaled > out[i]) ? scaled : out[i];
+    }
+}
+
+static void BlendAlpha(uint8_t *__restrict out, const uint8_t *__restrict in, uint32_t length, uint16_t weight)
+{
+    for (uint32_t i = 0; i < length; ++i)
+    {
+        out[i] = (uint8_t)((in[i] * weight + out[i] * (256 - weight)) >> 8);
+    }
+}
+
+void BlendLeds(CRGB *dst, const CRGB *src, uint16_t count, BlendMode mode, uint8_t opacity)
+{
+    if (opacity == 0)
+    {
+        return;
+    }
+    const uint32_t length = (uint32_t)count * sizeof(CRGB);
+    const uint16_t weight = (uint16_t)opacity + 1;
+    switch (mode)
+    {
+    case BlendMode::add:
+        BlendAdd(dst->raw, src->raw, length, weight);
+        break;
+    case BlendMode::max:
+        BlendMax(dst->raw, src->raw, length, weight);
+        break;
+    case BlendMode::alpha:
+        BlendAlpha(dst->raw, src->raw, length, weight);
+        break;
+    }
+}
+
+bool RenderLayers(Effect selected, int64_t now_ms, uint32_t dt_ms, const effectEvents_t &events)
+{
+    LedLayer selectedLayer;
+    if (!GetEffectLayer(selected, &selectedLayer))
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < (uint32_t)LedLayer::layer_count; ++i)
+    {
+        ledLayer_t *layer = &layers[i];
+        layer->outgoingFade_ms = FadeDown(layer->outgoingFade_ms, dt_ms);
+        if (i == (uint32_t)selectedLayer)
+        {
+            if (layer->fade_ms == 0)
+            {
+                // Hidden, so there is nothing worth fading out
+                ClearCanvas(&layer->canvas);
+                layer->outgoingFade_ms = 0;
+                ResetEffect(selected);
+            }
+            else if (layer->effect != selected)
+            {
+                layer->outgoing = layer->canvas;
+                layer->outgoingFade_ms = LAYER_CROSSFADE_MS;
+                ClearCanvas(&layer->canvas);
+                ResetEffect(selected);
+            }
+            layer->effect = selected;
+            layer->fade_ms = LAYER_CROSSFADE_MS;
+        }
+        else
+        {
+            layer->fade_ms = FadeDown(layer->fade_ms, dt_ms);
+        }
+        if (layer->fade_ms > 0)
+        {
+            PlayEffect(layer->effect, &layer->canvas, now_ms, dt_ms, events);
+        }
+    }
+
+    fill_solid(leds, NUM_LEDS, CRGB::Black);
+    bool isOutputBlack = true;
+    for (uint32_t i = 0; i < (uint32_t)LedLayer::layer_count; ++i)
+    {
+        const ledLayer_t *layer = &layers[i];
+        if (layer->fade_ms > 0)
+        {
+            BlendCanvas(&layer->canvas, layerModes[i], FadeOpacity(layer->fade_ms), &isOutputBlack);
+        }
+        // Over the new effect, or on an alpha layer the new one would hide it at full opacity
+        if (layer->outgoingFade_ms > 0)
+        {
+            BlendCanvas(&layer->outgoing, layerModes[i], FadeOpacity(layer->outgoingFade_ms), &isOutputBlack);
+        }
+    }
+    return true;
+}
+
+// Blend only the canvas's lit span where the black around it would change nothing
+static void BlendCanvas(const ledCanvas_t *canvas, BlendMode mode, uint8_t opacity, bool *isOutputBlack)
+{
+    if (mode == BlendMode::alpha && !*isOutputBlack)
+    {
+        // Mixing in black still darkens what is underneath
+        BlendLeds(leds, canvas->pixels, NUM_LEDS, mode, opacity);
+        return;
+    }
+    if (IsCanvasBlack(canvas))
+    {
+        return;
+    }
+    const ledSpan_t lit = LitSpan(canvas);
+    BlendLeds(&leds[lit.first], &canvas->pixels[lit.first], lit.length, mode, opacity);
+    *isOutputBlack = false;
+}
+
+static uint16_t FadeDown(uint16_t fade_ms, uint32_t dt_ms)
+{
+    return (fade_ms > dt_ms) ? (uint16_t)(fade_ms - dt_ms) : 0;
+}
+
+static uint8_t FadeOpacity(uint16_t fade_ms)
+{
+    return (uint8_t)((uint32_t)fade_ms * 255 / LAYER_CROSSFADE_MS);
+}
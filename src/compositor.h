@@ -0,0 +1,33 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+#include <FastLED.h>
+
+#include "config.h"
+#include "effects.h"
+#include "interface.h"
+
+// Each LedLayer gets its own canvas, so an effect never draws over another's leftovers, and
+// the layers are blended into leds from the bottom up. The selected effect plays on its
+// layer at full opacity, the others fade out over LAYER_CROSSFADE_MS still playing, and an
+// effect replaced on its own layer leaves its last frame fading out over the new one.
+// Layers are only blended over the span their canvas has lit.
+
+// How long a layer, or the effect replaced on one, takes to fade out
+#define LAYER_CROSSFADE_MS 300
+
+enum class BlendMode : uint8_t
+{
+    add,   // Saturating sum, for light on top of light
+    max,   // Brighter of the two per channel, effects over an underlay
+    alpha, // Mix by the opacity
+};
+
+// Blend count LEDs of src over dst, with src scaled by opacity first for add and max
+void BlendLeds(CRGB *dst, const CRGB *src, uint16_t count, BlendMode mode, uint8_t opacity);
+
+// Play the selected effect and whatever is still fading out, then composite them into leds.
+// Returns false if no sequence is registered for the effect.
+bool RenderLayers(Effect selected, int64_t now_ms, uint32_t dt_ms, const effectEvents_t &events);
+
+#endif // COMPOSITOR_H
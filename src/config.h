@@ -4,6 +4,12 @@
 #define NUMBER_X_LEDS 34
 #define NUMBER_Y_LEDS 5
 #define NUM_LEDS (NUMBER_X_LEDS * NUMBER_Y_LEDS)
+// How the strip runs through the matrix, see led_geometry.h
+#define LED_WIRING LedWiring::serpentine
+// The rows are split evenly between this many strips, one data pin each, first pin at the
+// bottom. The strips are sent in parallel, so show() takes as long as the longest strip.
+#define LED_STRIP_COUNT 1
+#define LED_STRIP_PINS {22}
 
 // max x and y values of LED matrix
 #define MAX_X_INDEX (NUMBER_X_LEDS - 1)
@@ -6,6 +6,7 @@
 #include <SPI.h>
 #include <Adafruit_NeoTrellis.h>
 #include <config.h>
+#include <radio_protocol.h>
 
 uint8_t com8Address[] = {0x0C, 0xB8, 0x15, 0xF8, 0xE6, 0x40};
 uint8_t com7Address[] = {0x0C, 0xB8, 0x15, 0xF8, 0xF6, 0x80};
@@ -13,9 +14,24 @@ uint8_t com7Address[] = {0x0C, 0xB8, 0x15, 0xF8, 0xF6, 0x80};
 // Must remain global!
 esp_now_peer_info_t peerInfo;
 
+// Sends to every registered peer, that is the hat
+class EspNowTransport : public RadioTransport
+{
+public:
+    bool Send(const uint8_t *packet, uint8_t length) override
+    {
+        return esp_now_send(0, packet, length) == ESP_OK;
+    }
+};
+
+EspNowTransport radioTransport;
+// Created in setup() once the hardware random number generator can pick the session
+RadioSender *radioSender = NULL;
+
 // callback when data is sent
 void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status)
 {
+    radioSender->OnSendStatus(status == ESP_NOW_SEND_SUCCESS);
     char macStr[18];
     Serial.print("Packet to: ");
     // Copies the sender mac address to a string
@@ -26,6 +42,12 @@ void OnDataSent(const uint8_t *mac_addr, esp_now_send_status_t status)
     Serial.println(status == ESP_NOW_SEND_SUCCESS ? "Delivery Success" : "Delivery Fail");
 }
 
+// callback when the hat acks a packet
+void OnDataReceived(const uint8_t *mac_addr, const uint8_t *incomingData, int data_len)
+{
+    radioSender->OnReceive(incomingData, data_len);
+}
+
 // --------- Trellis -----------
 #define Y_DIM 8 // number of rows of key
 #define X_DIM 4 // number of columns of keys
@@ -142,7 +164,9 @@ void setupWifiConnection()
         return;
     }
 
+    radioSender = new RadioSender(&radioTransport, (uint8_t)esp_random());
     esp_now_register_send_cb(OnDataSent);
+    esp_now_register_recv_cb(OnDataReceived);
 
     // register peer
     peerInfo.channel = 0;
@@ -158,27 +182,28 @@ void setupWifiConnection()
 
 void trySend()
 {
-    static radioData_t oldRadioData = radioData;
-    if (!(oldRadioData == radioData))
+    if (radioSender == NULL)
     {
-        esp_err_t result = esp_now_send(0, (uint8_t *)&radioData, sizeof(radioData_t));
-
-        if (result == ESP_OK)
-        {
-            Serial.println("Sent with success");
-            Serial.print("Effect enum: ");
-            Serial.println(radioData.effect);
-            Serial.print("Colour enum: ");
-            Serial.println(radioData.colour);
-            Serial.print("Ambient override: ");
-            Serial.println(radioData.ambientOverride);
-            oldRadioData = radioData;
-        }
-        else
-        {
-            Serial.println("Error sending the data");
-        }
+        return;
+    }
+    static radioSenderStats_t lastStats = {};
+    radioSender->Update(radioData, millis());
+    const radioSenderStats_t &stats = radioSender->Stats();
+    if (stats.ackedCount != lastStats.ackedCount)
+    {
+        Serial.println("Acked by the hat");
+        Serial.print("Effect enum: ");
+        Serial.println(radioData.effect);
+        Serial.print("Colour enum: ");
+        Serial.println(radioData.colour);
+        Serial.print("Ambient override: ");
+        Serial.println(radioData.ambientOverride);
+    }
+    if (stats.givenUpCount != lastStats.givenUpCount)
+    {
+        Serial.println("Error sending the data, no ack after retransmitting");
     }
+    lastStats = stats;
 }
 
 // ----- Brightness knob -----
@@ -0,0 +1,61 @@
+#include "decimator.h"
+
+#include <math.h>
+
+static float taps[DECIMATOR_TAP_COUNT];
+// Every sample is stored twice, DECIMATOR_TAP_COUNT apart, so the latest DECIMATOR_TAP_COUNT
+// samples are always contiguous and the dot product needs no wrap handling
+static float history[2 * DECIMATOR_TAP_COUNT];
+static uint32_t historyIndex = 0;
+
+void DecimatorInit()
+{
+    const float cutoff = DECIMATOR_CUTOFF_HZ / SAMPLING_FREQUENCY_HZ;
+    const float centre = (DECIMATOR_TAP_COUNT - 1) / 2.0f;
+    float gain = 0;
+    for (uint32_t t = 0; t < DECIMATOR_TAP_COUNT; ++t)
+    {
+        const float offset = t - centre;
+        const float sinc = (offset == 0) ? (2.0f * cutoff) : (sinf(2.0f * (float)M_PI * cutoff * offset) / ((float)M_PI * offset));
+        const float phase = 2.0f * (float)M_PI * t / (DECIMATOR_TAP_COUNT - 1);
+        const float blackman = 0.42f - 0.5f * cosf(phase) + 0.08f * cosf(2.0f * phase);
+        taps[t] = sinc * blackman;
+        gain += taps[t];
+    }
+    // Unity gain at DC keeps magnitudes comparable with the undecimated path
+    for (uint32_t t = 0; t < DECIMATOR_TAP_COUNT; ++t)
+    {
+        taps[t] /= gain;
+    }
+    for (uint32_t i = 0; i < 2 * DECIMATOR_TAP_COUNT; ++i)
+    {
+        history[i] = 0;
+    }
+    historyIndex = 0;
+}
+
+void Decimate(const int32_t *input, uint32_t count, int32_t *output)
+{
+    for (uint32_t i = 0; i < count; i += AUDIO_DECIMATION_FACTOR)
+    {
+        for (uint32_t phase = 0; phase < AUDIO_DECIMATION_FACTOR; ++phase)
+        {
+            const float sample = (float)input[i + phase];
+            history[historyIndex] = sample;
+            history[historyIndex + DECIMATOR_TAP_COUNT] = sample;
+            historyIndex = (historyIndex + 1) % DECIMATOR_TAP_COUNT;
+        }
+
+        // historyIndex is now the oldest of the latest DECIMATOR_TAP_COUNT samples.
+        // The taps are symmetric so their order against the history does not matter.
+        const float *latest = &history[historyIndex];
+        float accumulator = 0;
+        for (uint32_t t = 0; t < DECIMATOR_TAP_COUNT; ++t)
+        {
+            accumulator += taps[t] * latest[t];
+        }
+        // Ripple can push a full scale input just past the int32 range
+        accumulator = fminf(fmaxf(accumulator, (float)INT32_MIN), 2147483520.0f);
+        *output++ = (int32_t)accumulator;
+    }
+}
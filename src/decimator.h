@@ -0,0 +1,24 @@
+#ifndef DECIMATOR_H
+#define DECIMATOR_H
+
+#include <stdint.h>
+
+#include "beat_detection.h"
+
+// Low pass FIR and decimation by AUDIO_DECIMATION_FACTOR from the mic rate down to ANALYSIS_FREQUENCY_HZ.
+// Only every AUDIO_DECIMATION_FACTOR'th output is ever computed, so each mic sample costs
+// DECIMATOR_TAP_COUNT / AUDIO_DECIMATION_FACTOR multiply-adds.
+
+// Windowed sinc (Blackman) taps, designed once at boot by DecimatorInit()
+#define DECIMATOR_TAP_COUNT 128
+#define DECIMATOR_CUTOFF_HZ (0.4f * ANALYSIS_FREQUENCY_HZ)
+
+void DecimatorInit();
+
+// Filter and decimate count mic samples, count must be a multiple of AUDIO_DECIMATION_FACTOR
+// @param input[in]      Mic samples, oldest first
+// @param count[in]      Number of mic samples
+// @param output[out]    count / AUDIO_DECIMATION_FACTOR samples at ANALYSIS_FREQUENCY_HZ
+void Decimate(const int32_t *input, uint32_t count, int32_t *output);
+
+#endif // DECIMATOR_H
@@ -1,273 +1,409 @@
 #include "effects.h"
+
+#include <atomic>
+#include <utility>
+
 #include "interface.h"
+#include "led_geometry.h"
+#include "output_stage.h"
+#include "palette.h"
+#include "pattern_sprite.h"
+#include "profiling.h"
 
 // Initialise varialbes needed for FastLED
 #define LED_TYPE WS2812B
 #define COLOR_ORDER GRB
-#define LED_DATA_PIN 22
+// The LEDs hold their colour, so a frame that has not changed is not sent again. It is
+// still resent after this many, about once a second, in case an LED latched noise.
+#define LED_UNCHANGED_RESEND_FRAMES 64
 
 #define RANDOM_X random(MAX_X_INDEX + 1)
 #define RANDOM_Y random(MAX_Y_INDEX + 1)
 
-// default all colours to blue
-CRGB colour1 = CRGB::Blue;
-CRGB colour2 = CRGB::Blue;
-CRGB colour3 = CRGB::Blue;
-
+// The compositor blends its layers into leds every frame. PresentFrame() passes it through
+// the output stage into frontLeds, the only buffer FastLED sends from, so drawing never
+// races the transmitter.
 CRGB leds[NUM_LEDS] = {0};
-
-static int MapXYtoIndex(int x, int y);
-static void FadeLeds(int fadeBy);
+static CRGB frontLeds[NUM_LEDS] = {0};
+// Set while frontLeds is waiting to be sent or being sent
+static std::atomic<bool> isFrontBusy(false);
+static uint32_t skippedFrameCount = 0;
+static uint32_t unchangedFrameCount = 0;
+static uint32_t unchangedFramesInRow = 0;
+#ifndef NATIVE_BUILD
+static SemaphoreHandle_t frameReadySemaphore = NULL;
+#endif
+
+static uint8_t WaveRowPattern(uint16_t x, uint16_t y);
+static uint8_t WaveColumnPattern(uint16_t x, uint16_t y);
+static void FillRow(ledCanvas_t *canvas, int y, const CRGB &colour);
+static void FillColumn(ledCanvas_t *canvas, int x, const CRGB &colour);
 static void GenerateDistributedRandomNumbers(int *outBuffer, int count, int min, int max);
 static CRGB GetRandomColourChoice();
 
 
+// FastLED's ESP32 RMT driver starts every controller's channel and then waits for them all,
+// so the strips are sent in parallel, up to its 8 channels. Build with FASTLED_ESP32_I2S
+// defined to send up to 24 strips through the I2S peripheral instead.
+static constexpr uint8_t ledStripPins[] = LED_STRIP_PINS;
+static_assert(sizeof(ledStripPins) == LED_STRIP_COUNT, "Give every LED strip a data pin");
+
+template <size_t... STRIPS>
+static void AddLedStrips(std::index_sequence<STRIPS...>)
+{
+    (FastLED.addLeds<LED_TYPE, ledStripPins[STRIPS], COLOR_ORDER>(&frontLeds[HatGeometry::Strip(STRIPS).first],
+                                                                 HatGeometry::Strip(STRIPS).length),
+     ...);
+}
+
 void FastLedInit()
 {
-    FastLED.addLeds<LED_TYPE, LED_DATA_PIN, COLOR_ORDER>(leds, NUM_LEDS);
-    FastLED.setBrightness(radioData.brightness);
+    AddLedStrips(std::make_index_sequence<LED_STRIP_COUNT>());
+    // The output stage applies the brightness and dithers, see output_stage.h
+    FastLED.setBrightness(255);
+    FastLED.setDither(DISABLE_DITHER);
+    SetOutputBrightness(radioData.brightness);
+#ifndef NATIVE_BUILD
+    frameReadySemaphore = xSemaphoreCreateBinary();
+#endif
+}
 
+bool PresentFrame()
+{
+    if (isFrontBusy.load(std::memory_order_acquire))
+    {
+        // The layers keep their drawing, so the next frame carries it
+        ++skippedFrameCount;
+        return false;
+    }
+    // frontLeds still holds the last frame sent, so the output stage can tell if this one differs
+    TRACE_BEGIN(TraceStage::output);
+    const bool isChanged = RenderOutput(frontLeds, leds, NUM_LEDS);
+    TRACE_END(TraceStage::output);
+    if (!isChanged && ++unchangedFramesInRow < LED_UNCHANGED_RESEND_FRAMES)
+    {
+        ++unchangedFrameCount;
+        return false;
+    }
+    unchangedFramesInRow = 0;
+#ifdef NATIVE_BUILD
+    FastLED.show();
+#else
+    isFrontBusy.store(true, std::memory_order_release);
+    xSemaphoreGive(frameReadySemaphore);
+#endif
+    return true;
 }
 
-// ----- Effect functions -----
+#ifndef NATIVE_BUILD
+void TransmitFrame()
+{
+    xSemaphoreTake(frameReadySemaphore, portMAX_DELAY);
+    FastLED.show();
+    isFrontBusy.store(false, std::memory_order_release);
+}
+#endif
 
-void NoEffect()
+uint32_t SkippedFrameCount()
 {
-    FadeLeds(100);
+    return skippedFrameCount;
 }
 
-void WaveUp()
+uint32_t UnchangedFrameCount()
 {
-    static int16_t y = -1;
-    if (isBeatDetected)
+    return unchangedFrameCount;
+}
+
+// ----- Effect objects -----
+
+// Every effect fades the LEDs in steps of this, whatever the frame rate
+#define FADE_PERIOD_MS 15
+#define WAVE_STEP_PERIOD_MS 40
+#define TWINKLE_STEP_PERIOD_MS 20
+// The strobe flashes white for one frame in every period
+#define STROBE_FLASH_PERIOD_MS 80
+// The ray moved once a frame at the old 15 ms frame period, so it keeps that speed
+#define RAY_STEP_PERIOD_MS 15
+
+// Wave fronts drawn a row or a column at a time
+static PatternSprite waveRowSprite(WaveRowPattern);
+static PatternSprite waveColumnSprite(WaveColumnPattern);
+
+// Whole periods in the time rendered since the last call, keeping the remainder for the next
+static uint32_t TakeSteps(stepTimer_t *timer, uint32_t dt_ms)
+{
+    timer->elapsed_ms += dt_ms;
+    const uint32_t steps = timer->elapsed_ms / timer->period_ms;
+    timer->elapsed_ms -= steps * timer->period_ms;
+    return steps;
+}
+
+LedEffect::LedEffect(const char *effectName) : name(effectName), fadeTimer{FADE_PERIOD_MS, 0}
+{
+}
+
+void LedEffect::Reset()
+{
+    fadeTimer.elapsed_ms = 0;
+    ResetState();
+}
+
+void LedEffect::FadeLeds(ledCanvas_t *canvas, uint32_t dt_ms, uint8_t fadeBy)
+{
+    for (uint32_t steps = TakeSteps(&fadeTimer, dt_ms); steps > 0; --steps)
+    {
+        FadeCanvas(canvas, fadeBy);
+    }
+}
+
+class NoEffect : public LedEffect
+{
+public:
+    NoEffect() : LedEffect("no_effect") {}
+
+    void Render(ledCanvas_t *canvas, int64_t, uint32_t dt_ms, const effectEvents_t &) override
     {
-        y = MAX_Y_INDEX;
+        FadeLeds(canvas, dt_ms, 100);
     }
-    if (y >= 0)
+
+protected:
+    void ResetState() override {}
+};
+
+// A wave of rows from the top of the hat down on each beat
+class WaveUp : public LedEffect
+{
+public:
+    WaveUp() : LedEffect("wave_up") {}
+
+    void Render(ledCanvas_t *canvas, int64_t, uint32_t dt_ms, const effectEvents_t &events) override
     {
-        EVERY_N_MILLISECONDS(40)
+        if (events.isBeat)
         {
-            for (int x = 0; x <= MAX_X_INDEX; ++x)
-            { // Fill x row
-                // sequence of logic to create pattern
-                if ((y % 2 == 0) && (x % 2 != 0))
-                {
-                    leds[MapXYtoIndex(x, y)] = colour1;
-                }
-                else if ((y % 2 == 0) && (x % 2 == 0))
-                {
-                    leds[MapXYtoIndex(x, y)] = colour3;
-                }
-                else if (x % 2 == 0)
-                {
-                    leds[MapXYtoIndex(x, y)] = colour2;
-                }
-                else
-                {
-                    leds[MapXYtoIndex(x, y)] = colour3;
-                }
-            }
+            y = MAX_Y_INDEX;
+            // The first row lands on the beat's frame
+            stepTimer.elapsed_ms = stepTimer.period_ms;
+        }
+        for (uint32_t steps = TakeSteps(&stepTimer, dt_ms); steps > 0 && y >= 0; --steps)
+        {
+            waveRowSprite.BlitRow(canvas, y);
             y -= 1;
         }
+        FadeLeds(canvas, dt_ms, 100);
     }
-    FadeLeds(100);
-}
 
-void WaveClockwise()
+protected:
+    void ResetState() override
+    {
+        y = -1;
+        stepTimer.elapsed_ms = 0;
+    }
+
+private:
+    int16_t y = -1;
+    stepTimer_t stepTimer = {WAVE_STEP_PERIOD_MS, 0};
+};
+
+// A wave of rows from the bottom of the hat up on each beat
+class WaveDown : public LedEffect
 {
-    static int16_t x = 0;
-    if (x <= MAX_X_INDEX)
+public:
+    WaveDown() : LedEffect("wave_down") {}
+
+    void Render(ledCanvas_t *canvas, int64_t, uint32_t dt_ms, const effectEvents_t &events) override
     {
-        EVERY_N_MILLISECONDS(40)
+        if (events.isBeat)
         {
-            for (int y = 0; y <= MAX_Y_INDEX; ++y)
-            {
-                if ((x % 2 == 0) && (y % 2 != 0))
-                {
-                    leds[MapXYtoIndex(x, y)] = colour1;
-                }
-                else if ((x % 2 == 0) && (y % 2 == 0))
-                {
-                    leds[MapXYtoIndex(x, y)] = colour3;
-                }
-                else if (y % 2 == 0)
-                {
-                    leds[MapXYtoIndex(x, y)] = colour2;
-                }
-                else
-                {
-                    leds[MapXYtoIndex(x, y)] = colour3;
-                }
-            }
-            ++x;
+            y = 0;
+            stepTimer.elapsed_ms = stepTimer.period_ms;
         }
+        for (uint32_t steps = TakeSteps(&stepTimer, dt_ms); steps > 0 && y <= MAX_Y_INDEX; --steps)
+        {
+            waveRowSprite.BlitRow(canvas, y);
+            ++y;
+        }
+        FadeLeds(canvas, dt_ms, 100);
     }
-    else
+
+protected:
+    void ResetState() override
     {
-        x = 0;
+        y = MAX_Y_INDEX + 1;
+        stepTimer.elapsed_ms = 0;
     }
-    FadeLeds(40);
-}
 
-void WaveAnticlockwise()
+private:
+    int16_t y = MAX_Y_INDEX + 1;
+    stepTimer_t stepTimer = {WAVE_STEP_PERIOD_MS, 0};
+};
+
+// Columns sweeping round the hat without waiting for beats
+class WaveClockwise : public LedEffect
 {
-    static int16_t x = 0;
-    if (x >= 0)
+public:
+    WaveClockwise() : LedEffect("wave_clockwise") {}
+
+    void Render(ledCanvas_t *canvas, int64_t, uint32_t dt_ms, const effectEvents_t &) override
     {
-        EVERY_N_MILLISECONDS(40)
+        for (uint32_t steps = TakeSteps(&stepTimer, dt_ms); steps > 0; --steps)
         {
-            for (int y = 0; y <= MAX_Y_INDEX; ++y)
-            {
-                if ((x % 2 == 0) && (y % 2 != 0))
-                {
-                    leds[MapXYtoIndex(x, y)] = colour1;
-                }
-                else if ((x % 2 == 0) && (y % 2 == 0))
-                {
-                    leds[MapXYtoIndex(x, y)] = colour3;
-                }
-                else if (y % 2 == 0)
-                {
-                    leds[MapXYtoIndex(x, y)] = colour2;
-                }
-                else
-                {
-                    leds[MapXYtoIndex(x, y)] = colour3;
-                }
-            }
-            --x;
+            waveColumnSprite.BlitColumn(canvas, x);
+            x = (x == MAX_X_INDEX) ? 0 : x + 1;
         }
+        FadeLeds(canvas, dt_ms, 40);
     }
-    else
+
+protected:
+    void ResetState() override
     {
-        x = MAX_X_INDEX;
+        x = 0;
+        stepTimer.elapsed_ms = 0;
     }
-    FadeLeds(40);
-}
 
-void WaveDown()
+private:
+    int16_t x = 0;
+    stepTimer_t stepTimer = {WAVE_STEP_PERIOD_MS, 0};
+};
+
+class WaveAnticlockwise : public LedEffect
 {
-    static int16_t y = -1;
-    if (isBeatDetected)
-    {
-        y = 0;
-    }
-    if (y <= MAX_Y_INDEX)
+public:
+    WaveAnticlockwise() : LedEffect("wave_anticlockwise") {}
+
+    void Render(ledCanvas_t *canvas, int64_t, uint32_t dt_ms, const effectEvents_t &) override
     {
-        EVERY_N_MILLISECONDS(40)
+        for (uint32_t steps = TakeSteps(&stepTimer, dt_ms); steps > 0; --steps)
         {
-            for (int x = 0; x <= MAX_X_INDEX; ++x)
-            {
-                if ((y % 2 == 0) && (x % 2 != 0))
-                {
-                    leds[MapXYtoIndex(x, y)] = colour1;
-                }
-                else if ((y % 2 == 0) && (x % 2 == 0))
-                {
-                    leds[MapXYtoIndex(x, y)] = colour3;
-                }
-                else if (x % 2 == 0)
-                {
-                    leds[MapXYtoIndex(x, y)] = colour2;
-                }
-                else
-                {
-                    leds[MapXYtoIndex(x, y)] = colour3;
-                }
-            }
-            ++y;
+            waveColumnSprite.BlitColumn(canvas, x);
+            x = (x == 0) ? MAX_X_INDEX : x - 1;
         }
+        FadeLeds(canvas, dt_ms, 40);
     }
-    FadeLeds(100);
-}
 
-void VerticalBars()
+protected:
+    void ResetState() override
+    {
+        x = 0;
+        stepTimer.elapsed_ms = 0;
+    }
+
+private:
+    int16_t x = 0;
+    stepTimer_t stepTimer = {WAVE_STEP_PERIOD_MS, 0};
+};
+
+// Every third column lit on each beat, shifting along one each time
+class VerticalBars : public LedEffect
 {
-    if (isBeatDetected)
+public:
+    VerticalBars() : LedEffect("vertical_bars") {}
+
+    void Render(ledCanvas_t *canvas, int64_t, uint32_t dt_ms, const effectEvents_t &events) override
     {
-        static int xStart = 0;
-        for (int x = xStart; x <= MAX_X_INDEX; x += 3)
+        if (events.isBeat)
         {
-            for (int y = 0; y <= MAX_Y_INDEX; y++)
+            const CRGB colour = PaletteColour(PALETTE_PRIMARY);
+            for (int x = xStart; x < HatGeometry::width; x += 3)
             {
-                leds[MapXYtoIndex(x, y)] = colour1;
+                FillColumn(canvas, x, colour);
             }
+            xStart = (xStart == 3) ? 1 : xStart + 1;
         }
-        FastLED.show();
-        xStart = (xStart == 3) ? (xStart - 2) : ++xStart;
+        FadeLeds(canvas, dt_ms, 100);
     }
-    FadeLeds(100);
-}
 
-void HorizontalBars()
+protected:
+    void ResetState() override
+    {
+        xStart = 0;
+    }
+
+private:
+    int xStart = 0;
+};
+
+class HorizontalBars : public LedEffect
 {
-    if (isBeatDetected)
+public:
+    HorizontalBars() : LedEffect("horizontal_bars") {}
+
+    void Render(ledCanvas_t *canvas, int64_t, uint32_t dt_ms, const effectEvents_t &events) override
     {
-        static int yStart = 0;
-        for (int y = yStart; y <= MAX_X_INDEX; y += 3)
-        { // fill x
-            for (int x = 0; x <= MAX_Y_INDEX; x++)
-            { // fill y
-                leds[MapXYtoIndex(x, y)] = colour1;
+        if (events.isBeat)
+        {
+            const CRGB colour = PaletteColour(PALETTE_PRIMARY);
+            for (int y = yStart; y < HatGeometry::height; y += 3)
+            {
+                FillRow(canvas, y, colour);
             }
+            yStart = yStart ? yStart : 1; // TODO What is this logic :O
         }
-
-        FastLED.show();
-        yStart = yStart ? yStart : ++yStart; // TODO What is this logic :O
+        FadeLeds(canvas, dt_ms, 100);
     }
-    FadeLeds(100);
-}
 
-void RandomCross()
-{
-    if (isBeatDetected)
+protected:
+    void ResetState() override
     {
-        int randXs[3] = {0};
-        GenerateDistributedRandomNumbers(randXs, 3, 0, MAX_X_INDEX);
+        yStart = 0;
+    }
 
-        int randY = RANDOM_Y;
+private:
+    int yStart = 0;
+};
 
-        for (int x = 0; x <= MAX_X_INDEX; x++)
-        {
-            leds[MapXYtoIndex(x, randY)] = colour1;
-        }
+// A random row and three columns spread round the hat on each beat
+class RandomCross : public LedEffect
+{
+public:
+    RandomCross() : LedEffect("random_cross") {}
 
-        for (int y = 0; y <= MAX_Y_INDEX; y++)
+    void Render(ledCanvas_t *canvas, int64_t, uint32_t dt_ms, const effectEvents_t &events) override
+    {
+        if (events.isBeat)
         {
+            int randXs[3] = {0};
+            GenerateDistributedRandomNumbers(randXs, 3, 0, MAX_X_INDEX);
+
+            const CRGB colour = PaletteColour(PALETTE_PRIMARY);
+            int randY = RANDOM_Y;
+            FillRow(canvas, randY, colour);
             for (int i = 0; i < 3; i++)
             {
-                leds[MapXYtoIndex(randXs[i], y)] = colour1;
+                FillColumn(canvas, randXs[i], colour);
             }
         }
+        FadeLeds(canvas, dt_ms, 100);
     }
-    FadeLeds(100);
-}
 
-void HorizontalRay()
+protected:
+    void ResetState() override {}
+};
+
+// Two pairs of rays running both ways round a random row from each beat
+class HorizontalRay : public LedEffect
 {
-    static bool active = false;
-    static int counter = 0;
-    static int x1 = 0;
-    static int x2 = MAX_X_INDEX / 2;
-    static int y = -1;
+public:
+    HorizontalRay() : LedEffect("horizontal_ray") {}
 
-    if (isBeatDetected)
+    void Render(ledCanvas_t *canvas, int64_t, uint32_t dt_ms, const effectEvents_t &events) override
     {
-        active = true;
-        counter = 0;
-
-        y = RANDOM_Y;
-    }
+        if (events.isBeat)
+        {
+            active = true;
+            counter = 0;
+            y = RANDOM_Y;
+            stepTimer.elapsed_ms = stepTimer.period_ms;
+        }
 
-    if (active)
-    {
-        EVERY_N_MILLISECONDS(5)
+        const CRGB colour1 = PaletteColour(PALETTE_PRIMARY);
+        const CRGB colour2 = PaletteColour(PALETTE_SECONDARY);
+        for (uint32_t steps = TakeSteps(&stepTimer, dt_ms); steps > 0 && active; --steps)
         {
-            leds[MapXYtoIndex(x1 + counter, y)] = colour1;
-            leds[MapXYtoIndex(x1 - counter, y)] = colour1;
+            SetPixel(canvas, HatGeometry::Index(HatGeometry::WrapX(x1 + counter), y), colour1);
+            SetPixel(canvas, HatGeometry::Index(HatGeometry::WrapX(x1 - counter), y), colour1);
 
-            leds[MapXYtoIndex(x2 + counter, y)] = colour2;
-            leds[MapXYtoIndex(x2 - counter, y)] = colour2;
+            SetPixel(canvas, HatGeometry::Index(HatGeometry::WrapX(x2 + counter), y), colour2);
+            SetPixel(canvas, HatGeometry::Index(HatGeometry::WrapX(x2 - counter), y), colour2);
 
             if (++counter > NUMBER_X_LEDS / 4 + (NUMBER_X_LEDS % 4 != 0))
             {
@@ -275,85 +411,284 @@ void HorizontalRay()
                 counter = 0;
             }
         }
+
+        FadeLeds(canvas, dt_ms, 100);
     }
 
-    FadeLeds(100);
-}
+protected:
+    void ResetState() override
+    {
+        active = false;
+        counter = 0;
+        y = -1;
+        stepTimer.elapsed_ms = 0;
+    }
+
+private:
+    static constexpr int x1 = 0;
+    static constexpr int x2 = MAX_X_INDEX / 2;
+    bool active = false;
+    int counter = 0;
+    int y = -1;
+    stepTimer_t stepTimer = {RAY_STEP_PERIOD_MS, 0};
+};
 
-void Twinkle()
+class Twinkle : public LedEffect
 {
-    FadeLeds(20);
-    EVERY_N_MILLIS(20)
+public:
+    Twinkle() : LedEffect("twinkle") {}
+
+    void Render(ledCanvas_t *canvas, int64_t, uint32_t dt_ms, const effectEvents_t &) override
     {
-        leds[MapXYtoIndex(RANDOM_X, RANDOM_Y)] = GetRandomColourChoice();
-        leds[MapXYtoIndex(RANDOM_X, RANDOM_Y)] = GetRandomColourChoice();
-        leds[MapXYtoIndex(RANDOM_X, RANDOM_Y)] = GetRandomColourChoice();
-        leds[MapXYtoIndex(RANDOM_X, RANDOM_Y)] = GetRandomColourChoice();
+        FadeLeds(canvas, dt_ms, 20);
+        for (uint32_t steps = TakeSteps(&stepTimer, dt_ms); steps > 0; --steps)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                // The colour takes its random number before the position does
+                const CRGB colour = GetRandomColourChoice();
+                SetPixel(canvas, HatGeometry::Index(RANDOM_X, RANDOM_Y), colour);
+            }
+        }
     }
-}
 
-void Strobe()
+protected:
+    void ResetState() override
+    {
+        stepTimer.elapsed_ms = 0;
+    }
+
+private:
+    stepTimer_t stepTimer = {TWINKLE_STEP_PERIOD_MS, 0};
+};
+
+class Strobe : public LedEffect
 {
-    FastLED.clear();
-    EVERY_N_MILLISECONDS(40)
+public:
+    Strobe() : LedEffect("strobe") {}
+
+    void Render(ledCanvas_t *canvas, int64_t, uint32_t dt_ms, const effectEvents_t &) override
     {
-        fill_solid(leds, NUM_LEDS, CRGB::White);
+        if (TakeSteps(&flashTimer, dt_ms) > 0)
+        {
+            fill_solid(canvas->pixels, NUM_LEDS, CRGB::White);
+            MarkLit(canvas, {0, NUM_LEDS});
+        }
+        else
+        {
+            ClearCanvas(canvas);
+        }
     }
 
-    EVERY_N_MILLISECONDS(80)
+protected:
+    void ResetState() override
     {
-        fill_solid(leds, NUM_LEDS, CRGB::Black);
+        flashTimer.elapsed_ms = 0;
     }
+
+private:
+    stepTimer_t flashTimer = {STROBE_FLASH_PERIOD_MS, 0};
+};
+
+static NoEffect noEffect;
+static WaveUp waveUp;
+static WaveDown waveDown;
+static WaveClockwise waveClockwise;
+static WaveAnticlockwise waveAnticlockwise;
+static VerticalBars verticalBars;
+static HorizontalBars horizontalBars;
+static RandomCross randomCross;
+static HorizontalRay horizontalRay;
+static Twinkle twinkle;
+static Strobe strobe;
+
+static LedEffect *const ledEffects[] = {
+    &noEffect, &waveUp, &waveDown, &waveClockwise, &waveAnticlockwise, &verticalBars,
+    &horizontalBars, &randomCross, &horizontalRay, &twinkle, &strobe,
+};
+#define LED_EFFECT_COUNT (sizeof(ledEffects) / sizeof(ledEffects[0]))
+
+uint32_t LedEffectCount()
+{
+    return LED_EFFECT_COUNT;
 }
 
-void ControlLed(bool beatDetected)
+LedEffect *GetLedEffect(uint32_t index)
 {
-    if (beatDetected)
+    return (index < LED_EFFECT_COUNT) ? ledEffects[index] : nullptr;
+}
+
+// ----- Effect registry -----
+
+// Every sequence steps through up to this many effects
+#define EFFECT_MAX_STEPS 4
+// Effect values index the lookup directly, they are the controller's keypad indices
+#define EFFECT_LOOKUP_LENGTH (MAX_EFFECT_KEYPAD_INDEX + 1)
+
+typedef struct effectSequence_t
+{
+    Effect effect;
+    LedLayer layer;
+    // Played in turn, moving on at each beat, up to the first empty step
+    LedEffect *steps[EFFECT_MAX_STEPS];
+} effectSequence_s;
+
+// One entry per effect, the only place a sequence is defined
+static constexpr effectSequence_t effectSequences[] = {
+    {Effect::wave_flash_double, LedLayer::beat, {&waveUp, &waveUp, &verticalBars, &verticalBars}},
+    {Effect::vertical_bars_clockwise, LedLayer::beat, {&verticalBars}},
+    {Effect::wave_up, LedLayer::beat, {&waveUp}},
+    {Effect::wave_down, LedLayer::beat, {&waveDown}},
+    {Effect::wave_up_down, LedLayer::beat, {&waveDown, &waveUp}},
+    {Effect::random_cross, LedLayer::beat, {&randomCross}},
+    {Effect::horizontal_ray, LedLayer::beat, {&horizontalRay}},
+    {Effect::strobe, LedLayer::strobe, {&strobe}},
+    {Effect::wave_anticlockwise, LedLayer::ambient, {&waveAnticlockwise}},
+    {Effect::wave_clockwise, LedLayer::ambient, {&waveClockwise}},
+    {Effect::twinkle, LedLayer::ambient, {&twinkle}},
+    {Effect::no_effect, LedLayer::ambient, {&noEffect}},
+};
+#define EFFECT_SEQUENCE_COUNT (sizeof(effectSequences) / sizeof(effectSequences[0]))
+
+typedef struct effectLookup_t
+{
+    int8_t sequenceIndex[EFFECT_LOOKUP_LENGTH]; // -1 for values with no sequence
+    uint8_t stepCount[EFFECT_SEQUENCE_COUNT];
+    bool isValid; // Every entry in range, registered once and with a first step
+} effectLookup_s;
+
+static constexpr effectLookup_t BuildEffectLookup()
+{
+    effectLookup_t lookup = {};
+    lookup.isValid = true;
+    for (uint32_t value = 0; value < EFFECT_LOOKUP_LENGTH; ++value)
+    {
+        lookup.sequenceIndex[value] = -1;
+    }
+    for (uint32_t i = 0; i < EFFECT_SEQUENCE_COUNT; ++i)
     {
-        for (int x = 0; x <= MAX_X_INDEX; ++x)
+        const int value = (int)effectSequences[i].effect;
+        if (value < 0 || value >= EFFECT_LOOKUP_LENGTH || lookup.sequenceIndex[value] != -1)
         {
-            for (int y = 0; y <= MAX_Y_INDEX; ++y)
-            {
-                leds[MapXYtoIndex(x, y)] = CRGB::Blue;
-            }
+            lookup.isValid = false;
+            continue;
         }
+        lookup.sequenceIndex[value] = i;
+        while (lookup.stepCount[i] < EFFECT_MAX_STEPS && effectSequences[i].steps[lookup.stepCount[i]] != nullptr)
+        {
+            ++lookup.stepCount[i];
+        }
+        lookup.isValid &= (lookup.stepCount[i] > 0);
     }
-    else
+    return lookup;
+}
+
+static constexpr effectLookup_t effectLookup = BuildEffectLookup();
+static_assert(effectLookup.isValid, "Register every effect once, with a value below EFFECT_LOOKUP_LENGTH and at least one step");
+
+static constexpr bool AreAllRegistered(const Effect *effects, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
     {
-        FadeLeds(400);
+        if (effectLookup.sequenceIndex[(int)effects[i]] == -1)
+        {
+            return false;
+        }
     }
+    return true;
 }
+static_assert(AreAllRegistered(beatEffectEnumValues, sizeof(beatEffectEnumValues) / sizeof(beatEffectEnumValues[0])), "Every beat effect needs a registry entry");
+static_assert(AreAllRegistered(ambientEffectEnumValues, sizeof(ambientEffectEnumValues) / sizeof(ambientEffectEnumValues[0])), "Every ambient effect needs a registry entry");
 
-// ----- Effect utils -----
+// Current step of each sequence
+static uint8_t sequencePositions[EFFECT_SEQUENCE_COUNT] = {0};
+
+// Sequence index of a registered effect, -1 otherwise
+static int FindSequence(Effect effect)
+{
+    const uint8_t value = (uint8_t)effect;
+    return (value < EFFECT_LOOKUP_LENGTH) ? effectLookup.sequenceIndex[value] : -1;
+}
+
+bool GetEffectLayer(Effect effect, LedLayer *layer)
+{
+    const int sequence = FindSequence(effect);
+    if (sequence == -1)
+    {
+        return false;
+    }
+    *layer = effectSequences[sequence].layer;
+    return true;
+}
 
-// Map any x, y coordinate on LED matrix to LED array index
-static int MapXYtoIndex(int x, int y)
+void ResetEffect(Effect effect)
 {
-    x %= NUMBER_X_LEDS;
-    if (x < 0)
+    const int sequence = FindSequence(effect);
+    if (sequence == -1)
     {
-        x += NUMBER_X_LEDS;
+        return;
     }
-    int i;
-    if (y % 2 == 0)
+    for (uint8_t step = 0; step < effectLookup.stepCount[sequence]; ++step)
     {
-        i = x + (MAX_X_INDEX + 1) * y; // i steps up by MAX_X_INDEX+1 each row
+        effectSequences[sequence].steps[step]->Reset();
     }
-    // LED strips setup in alternating direction so x value flips sign
-    else
+}
+
+bool PlayEffect(Effect effect, ledCanvas_t *canvas, int64_t now_ms, uint32_t dt_ms, const effectEvents_t &events)
+{
+    const int sequence = FindSequence(effect);
+    if (sequence == -1)
+    {
+        return false;
+    }
+    uint8_t *position = &sequencePositions[sequence];
+    if (events.isBeat && ++*position >= effectLookup.stepCount[sequence])
+    {
+        *position = 0;
+    }
+    effectSequences[sequence].steps[*position]->Render(canvas, now_ms, dt_ms, events);
+    return true;
+}
+
+// ----- Effect utils -----
+
+// Palette position of one LED of the wave pattern, alternating along the wave front and from
+// one front to the next
+static uint8_t WavePosition(int along, int across)
+{
+    if (across % 2 == 0)
     {
-        i = (MAX_X_INDEX + 1) * (y + 1) - (x + 1);
+        return (along % 2 != 0) ? PALETTE_PRIMARY : PALETTE_ACCENT;
     }
+    return (along % 2 == 0) ? PALETTE_SECONDARY : PALETTE_ACCENT;
+}
+
+// Rows are the wave fronts
+static uint8_t WaveRowPattern(uint16_t x, uint16_t y)
+{
+    return WavePosition(x, y);
+}
 
-    return i;
+// Columns are the wave fronts
+static uint8_t WaveColumnPattern(uint16_t x, uint16_t y)
+{
+    return WavePosition(y, x);
 }
 
-static void FadeLeds(int fadeBy)
+static void FillRow(ledCanvas_t *canvas, int y, const CRGB &colour)
 {
-    EVERY_N_MILLIS(15)
+    const ledSpan_t row = HatGeometry::Row(y);
+    fill_solid(&canvas->pixels[row.first], row.length, colour);
+    MarkLit(canvas, row);
+}
+
+static void FillColumn(ledCanvas_t *canvas, int x, const CRGB &colour)
+{
+    for (const uint16_t index : HatGeometry::Column(x))
     {
-        fadeToBlackBy(leds, NUM_LEDS, fadeBy);
+        canvas->pixels[index] = colour;
     }
+    MarkLit(canvas, HatGeometry::ColumnSpan(x));
 }
 
 static void GenerateDistributedRandomNumbers(int *outBuffer, int count, int min, int max)
@@ -367,17 +702,8 @@ static void GenerateDistributedRandomNumbers(int *outBuffer, int count, int min,
     outBuffer[count - 1] = random(min + zoneSize * (count - 1), max + 1);
 }
 
+// Anywhere along the palette, not just the colours it was built from
 static CRGB GetRandomColourChoice()
 {
-    switch (random(3))
-    {
-    case 0:
-        return colour1;
-    case 1:
-        return colour2;
-    case 2:
-        return colour3;
-    default:
-        return colour1;
-    }
+    return PaletteColour((uint8_t)random(256));
 }
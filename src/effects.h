@@ -3,89 +3,87 @@
 
 #include <FastLED.h>
 #include <config.h>
-#include "beat_detection.h"
-
-extern CRGB colour1;
-extern CRGB colour2;
-extern CRGB colour3;
-
-typedef void (*effect_function_ptr_t)();
-typedef const effect_function_ptr_t effect_array_t[];
-
-void ControlLed(bool);
-
-//-------------- Ambient effect arrays --------------
-void NoEffect();
-void Twinkle();
-void Strobe();
-void WaveClockwise();
-void WaveAnticlockwise();
-
-effect_array_t no_effect = {NoEffect};
-effect_array_t twinkle_ = {Twinkle};
-effect_array_t wave_clockwise = {WaveClockwise};
-effect_array_t wave_anticlockwise = {WaveAnticlockwise};
-effect_array_t strobe_ = {Strobe};
-
-//-------------- Beat effect arrays --------------
-void VerticalBars();
-void WaveUp();
-void WaveDown();
-void RandomCross();
-void HorizontalRay();
-void FastLedInit();
-void HorizontalBars();
+#include "interface.h"
+#include "led_canvas.h"
 
-effect_array_t vertical_bars_clockwise = {
-    VerticalBars,
-};
-effect_array_t wave_up = {
-    WaveUp,
-};
-effect_array_t wave_down = {
-    WaveDown,
-};
-effect_array_t wave_up_down = {
-    WaveDown,
-    WaveUp,
-};
-effect_array_t wave_flash_double = {
-    WaveUp,
-    WaveUp,
-    VerticalBars,
-    VerticalBars,
-};
-effect_array_t eigh_wave_eight_bars = {
-    WaveUp,
-    WaveUp,
-    WaveUp,
-    WaveUp,
-    WaveUp,
-    WaveUp,
-    WaveUp,
-    WaveUp,
-    VerticalBars,
-    VerticalBars,
-    VerticalBars,
-    VerticalBars,
-    VerticalBars,
-    VerticalBars,
-    VerticalBars,
-    VerticalBars,
-    WaveDown,
-    WaveDown,
-    WaveDown,
-    WaveDown,
-    WaveDown,
-    WaveDown,
-    WaveDown,
-    WaveDown,
-};
-effect_array_t random_cross = {
-    RandomCross,
+// The composited frame, see compositor.h and PresentFrame()
+extern CRGB leds[NUM_LEDS];
+
+// Layers of the frame from the bottom up, each effect is registered to draw on one
+enum class LedLayer : uint8_t
+{
+    ambient,
+    beat,
+    strobe,
+    layer_count,
 };
-effect_array_t horizontal_ray = {
-    HorizontalRay,
+
+// What happened since the last frame, for the effects to react to
+typedef struct effectEvents_t
+{
+    bool isBeat;
+} effectEvents_s;
+
+// Counts whole periods of rendered time, EVERY_N_MILLISECONDS driven by the frame times
+// instead of the clock
+typedef struct stepTimer_t
+{
+    uint32_t period_ms;
+    uint32_t elapsed_ms;
+} stepTimer_s;
+
+// An effect draws onto the canvas it is given from its own state and the times it is given,
+// never from the clock or globals, so the same frame times and events always draw the same frames.
+class LedEffect
+{
+public:
+    explicit LedEffect(const char *effectName);
+
+    const char *const name;
+
+    // Back to how it starts when first selected, the LEDs are left to fade
+    void Reset();
+
+    // Draw one frame
+    // @param canvas    To draw over, holding whatever was drawn on it last frame
+    // @param now_ms    Time of this frame
+    // @param dt_ms     Time since the last frame, several periods after skipped frames
+    // @param events    Beats since the last frame
+    virtual void Render(ledCanvas_t *canvas, int64_t now_ms, uint32_t dt_ms, const effectEvents_t &events) = 0;
+
+protected:
+    virtual void ResetState() = 0;
+    // Fade every LED by fadeBy for each 15 ms rendered, as every effect did before
+    void FadeLeds(ledCanvas_t *canvas, uint32_t dt_ms, uint8_t fadeBy);
+
+private:
+    stepTimer_t fadeTimer;
 };
 
+// Hand the frame composited in leds to the transmitter. Returns false without waiting if the
+// frame is not sent: counting a skipped frame if the previous one is still being sent, or an
+// unchanged frame if the LEDs already show it. The native build sends it here.
+bool PresentFrame();
+#ifndef NATIVE_BUILD
+// Wait for a presented frame and send it to the LEDs, loop on this in the transmitter task.
+// FastLED blocks on the RMT interrupts while sending, so the core is free for the render task.
+void TransmitFrame();
+#endif
+uint32_t SkippedFrameCount();
+uint32_t UnchangedFrameCount();
+
+void FastLedInit();
+
+// Draw one frame of the effect's sequence onto canvas, moving to its next step on a beat.
+// Every sequence keeps its own place. Returns false if no sequence is registered for the effect.
+bool PlayEffect(Effect effect, ledCanvas_t *canvas, int64_t now_ms, uint32_t dt_ms, const effectEvents_t &events);
+// Reset every effect in the sequence, before playing it onto a cleared canvas
+void ResetEffect(Effect effect);
+// Returns false if no sequence is registered for the effect
+bool GetEffectLayer(Effect effect, LedLayer *layer);
+
+// Every effect object, for tools that exercise them one at a time
+uint32_t LedEffectCount();
+LedEffect *GetLedEffect(uint32_t index);
+
 #endif // EFFECTS_H
\ No newline at end of file
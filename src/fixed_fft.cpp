@@ -0,0 +1,262 @@
+#include "fixed_fft.h"
+
+#define COMPLEX_FFT_LENGTH (FIXED_FFT_LENGTH / 2)
+
+#define Q15_ONE 32768
+// pi / 2 and 2 * pi in Q30
+#define Q30_HALF_PI 1686629713LL
+#define Q30_TWO_PI 6746518852LL
+// Hamming coefficients in Q30
+#define Q30_HAMMING_A 579820585LL
+#define Q30_HAMMING_B 493921239LL
+
+static_assert((FIXED_FFT_LENGTH & (FIXED_FFT_LENGTH - 1)) == 0, "FIXED_FFT_LENGTH must be a power of two");
+
+// Same layout as the float tables: cos(2 * pi * k / N) for k in [0, 3N/4) and half a Hamming window
+static int16_t cosineTable[3 * FIXED_FFT_LENGTH / 4];
+static int16_t hammingTable[FIXED_FFT_LENGTH / 2];
+
+static int64_t SinQ30(int64_t angle);
+static int64_t CosQ30(int64_t angle);
+static int16_t Q30ToQ15(int64_t value);
+static void ComplexFft(int32_t *data);
+static uint32_t SquareRoot(uint64_t value);
+
+static inline int32_t TwiddleCos(uint32_t k)
+{
+    return cosineTable[k];
+}
+
+static inline int32_t TwiddleSin(uint32_t k)
+{
+    return -cosineTable[k + FIXED_FFT_LENGTH / 4];
+}
+
+void FixedFftInit()
+{
+    for (uint32_t k = 0; k < 3 * FIXED_FFT_LENGTH / 4; ++k)
+    {
+        cosineTable[k] = Q30ToQ15(CosQ30(Q30_TWO_PI * k / FIXED_FFT_LENGTH));
+    }
+    for (uint32_t n = 0; n < FIXED_FFT_LENGTH / 2; ++n)
+    {
+        const int64_t cosine = CosQ30(Q30_TWO_PI * n / (FIXED_FFT_LENGTH - 1));
+        hammingTable[n] = Q30ToQ15(Q30_HAMMING_A - ((Q30_HAMMING_B * cosine) >> 30));
+    }
+}
+
+void FixedFftLoadSamples(const int32_t sampleRing[FIXED_FFT_LENGTH], uint32_t oldestIndex, int64_t sampleSum,
+                         int32_t buffer[FIXED_FFT_LENGTH])
+{
+    const int64_t mean = sampleSum / FIXED_FFT_LENGTH;
+    for (uint32_t i = 0; i < FIXED_FFT_LENGTH / 2; ++i)
+    {
+        const int64_t window = hammingTable[i];
+        const uint32_t mirror = FIXED_FFT_LENGTH - 1 - i;
+        const int64_t sample = (sampleRing[(oldestIndex + i) & (FIXED_FFT_LENGTH - 1)] - mean) >> FIXED_FFT_INPUT_SHIFT;
+        const int64_t mirrorSample = (sampleRing[(oldestIndex + mirror) & (FIXED_FFT_LENGTH - 1)] - mean) >> FIXED_FFT_INPUT_SHIFT;
+        buffer[i] = (int32_t)((sample * window) >> 15);
+        buffer[mirror] = (int32_t)((mirrorSample * window) >> 15);
+    }
+}
+
+void FixedFftCompute(int32_t buffer[FIXED_FFT_LENGTH])
+{
+    ComplexFft(buffer);
+
+    // Same split as RealFftComputePower(), computing X / 2 to stay within int32
+    const int64_t dc = ((int64_t)buffer[0] + buffer[1]) >> 1;
+    const int64_t nyquist = ((int64_t)buffer[0] - buffer[1]) >> 1;
+    for (uint32_t k = 1; k < COMPLEX_FFT_LENGTH / 2; ++k)
+    {
+        int32_t *zk = &buffer[2 * k];
+        int32_t *zmk = &buffer[2 * (COMPLEX_FFT_LENGTH - k)];
+        // Twice Fe and Fo
+        const int64_t evenRe = (int64_t)zk[0] + zmk[0];
+        const int64_t evenIm = (int64_t)zk[1] - zmk[1];
+        const int64_t oddRe = (int64_t)zk[1] + zmk[1];
+        const int64_t oddIm = -((int64_t)zk[0] - zmk[0]);
+        const int64_t wr = TwiddleCos(k);
+        const int64_t wi = -TwiddleSin(k);
+        const int64_t twiddledRe = (wr * oddRe - wi * oddIm) >> 15;
+        const int64_t twiddledIm = (wr * oddIm + wi * oddRe) >> 15;
+        zk[0] = (int32_t)((evenRe + twiddledRe) >> 2);
+        zk[1] = (int32_t)((evenIm + twiddledIm) >> 2);
+        zmk[0] = (int32_t)((evenRe - twiddledRe) >> 2);
+        zmk[1] = (int32_t)(-(evenIm - twiddledIm) >> 2);
+    }
+    // X[M/2] = conj(Z[M/2]), halved like the rest
+    buffer[COMPLEX_FFT_LENGTH] >>= 1;
+    buffer[COMPLEX_FFT_LENGTH + 1] = -(buffer[COMPLEX_FFT_LENGTH + 1] >> 1);
+    buffer[0] = (int32_t)dc;
+    buffer[1] = (int32_t)nyquist;
+}
+
+int64_t FixedFftBinPower(const int32_t buffer[FIXED_FFT_LENGTH], uint32_t bin)
+{
+    if (bin == 0 || bin == COMPLEX_FFT_LENGTH)
+    {
+        const int64_t value = buffer[(bin == 0) ? 0 : 1];
+        return value * value;
+    }
+    const int64_t re = buffer[2 * bin];
+    const int64_t im = buffer[2 * bin + 1];
+    return re * re + im * im;
+}
+
+uint32_t FixedFftBinMagnitude(const int32_t buffer[FIXED_FFT_LENGTH], uint32_t bin)
+{
+    return SquareRoot((uint64_t)FixedFftBinPower(buffer, bin));
+}
+
+int64_t FixedFftMajorPeakQ8(const int32_t buffer[FIXED_FFT_LENGTH], uint32_t samplingFrequency)
+{
+    // Power is worked out as the scan passes each bin rather than stored, saving a 4 KB buffer
+    int64_t maxPower = 0;
+    uint32_t peakIndex = 0;
+    int64_t before = FixedFftBinPower(buffer, 0);
+    int64_t current = FixedFftBinPower(buffer, 1);
+    for (uint32_t i = 1; i < FIXED_FFT_BIN_COUNT - 1; ++i)
+    {
+        const int64_t after = FixedFftBinPower(buffer, i + 1);
+        if ((before < current) && (current > after) && (current > maxPower))
+        {
+            maxPower = current;
+            peakIndex = i;
+        }
+        before = current;
+        current = after;
+    }
+    if (peakIndex == 0)
+    {
+        return 0;
+    }
+
+    const int64_t magnitudeBefore = FixedFftBinMagnitude(buffer, peakIndex - 1);
+    const int64_t magnitudePeak = FixedFftBinMagnitude(buffer, peakIndex);
+    const int64_t magnitudeAfter = FixedFftBinMagnitude(buffer, peakIndex + 1);
+    const int64_t denominator = magnitudeBefore - 2 * magnitudePeak + magnitudeAfter;
+    const int64_t deltaQ8 = (denominator == 0) ? 0 : (((magnitudeBefore - magnitudeAfter) << 7) / denominator);
+    return (((int64_t)peakIndex << 8) + deltaQ8) * samplingFrequency / FIXED_FFT_LENGTH;
+}
+
+// In-place radix 2 decimation in time FFT over COMPLEX_FFT_LENGTH interleaved complex values,
+// every stage is halved so values never grow past the input's magnitude
+static void ComplexFft(int32_t *data)
+{
+    for (uint32_t i = 0, j = 0; i < COMPLEX_FFT_LENGTH - 1; ++i)
+    {
+        if (i < j)
+        {
+            int32_t re = data[2 * i];
+            int32_t im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+        uint32_t bit = COMPLEX_FFT_LENGTH >> 1;
+        while (j & bit)
+        {
+            j ^= bit;
+            bit >>= 1;
+        }
+        j |= bit;
+    }
+
+    for (uint32_t length = 2; length <= COMPLEX_FFT_LENGTH; length <<= 1)
+    {
+        const uint32_t half = length >> 1;
+        const uint32_t twiddleStride = FIXED_FFT_LENGTH / length;
+        for (uint32_t j = 0; j < half; ++j)
+        {
+            const int64_t wr = TwiddleCos(j * twiddleStride);
+            const int64_t wi = -TwiddleSin(j * twiddleStride);
+            for (uint32_t i = j; i < COMPLEX_FFT_LENGTH; i += length)
+            {
+                int32_t *a = &data[2 * i];
+                int32_t *b = &data[2 * (i + half)];
+                // Q15 twiddle plus the stage's halving in one shift
+                const int32_t re = (int32_t)((b[0] * wr - b[1] * wi) >> 16);
+                const int32_t im = (int32_t)((b[0] * wi + b[1] * wr) >> 16);
+                const int32_t aRe = a[0] >> 1;
+                const int32_t aIm = a[1] >> 1;
+                a[0] = aRe + re;
+                a[1] = aIm + im;
+                b[0] = aRe - re;
+                b[1] = aIm - im;
+            }
+        }
+    }
+}
+
+// sin of an angle in [0, pi / 2], Taylor series to x^11 which is well inside Q15 accuracy
+static int64_t SinQ30(int64_t angle)
+{
+    const int64_t angleSquared = (angle * angle) >> 30;
+    int64_t term = angle;
+    int64_t sum = angle;
+    for (int64_t n = 2; n <= 10; n += 2)
+    {
+        term = ((term * angleSquared) >> 30) / (n * (n + 1));
+        sum += (n % 4 == 2) ? -term : term;
+    }
+    return sum;
+}
+
+// cos of an angle in [0, 2 * pi), folded onto the first quadrant
+static int64_t CosQ30(int64_t angle)
+{
+    const int64_t quadrant = angle / Q30_HALF_PI;
+    const int64_t remainder = angle - quadrant * Q30_HALF_PI;
+    switch (quadrant & 3)
+    {
+    case 0:
+        return SinQ30(Q30_HALF_PI - remainder);
+    case 1:
+        return -SinQ30(remainder);
+    case 2:
+        return -SinQ30(Q30_HALF_PI - remainder);
+    default:
+        return SinQ30(remainder);
+    }
+}
+
+static int16_t Q30ToQ15(int64_t value)
+{
+    const int64_t rounded = (value + (1 << 14)) >> 15;
+    if (rounded >= Q15_ONE)
+    {
+        return Q15_ONE - 1;
+    }
+    if (rounded < -Q15_ONE)
+    {
+        return -Q15_ONE;
+    }
+    return (int16_t)rounded;
+}
+
+// Bit by bit integer square root
+static uint32_t SquareRoot(uint64_t value)
+{
+    uint64_t root = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+    while (bit != 0)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
@@ -0,0 +1,46 @@
+#ifndef FIXED_FFT_H
+#define FIXED_FFT_H
+
+#include <stdint.h>
+
+#include "beat_detection.h"
+
+// Integer only version of the real input FFT in real_fft.h. Tables are generated with integer
+// maths too, so for the same samples every target produces exactly the same bins.
+//
+// Samples are taken as int32 with two bits of headroom, windowed with a Q15 Hamming table and
+// transformed with Q15 twiddles, halving every butterfly stage so nothing can overflow.
+// Bins come out 2^FIXED_FFT_SCALE_SHIFT smaller than the float FFT's.
+
+#define FIXED_FFT_LENGTH FFT_BUFFER_LENGTH
+#define FIXED_FFT_BIN_COUNT (FIXED_FFT_LENGTH / 2 + 1)
+
+constexpr uint32_t FixedFftLog2(uint32_t value)
+{
+    return (value <= 1) ? 0 : 1 + FixedFftLog2(value / 2);
+}
+
+#define FIXED_FFT_INPUT_SHIFT 2
+#define FIXED_FFT_SCALE_SHIFT (FIXED_FFT_INPUT_SHIFT + FixedFftLog2(FIXED_FFT_LENGTH / 2) + 1)
+
+void FixedFftInit();
+
+// Remove DC, scale and apply a Hamming window in one pass over the samples
+// @param sampleRing[in]     Ring of the latest FIXED_FFT_LENGTH samples as read from the mic
+// @param oldestIndex[in]    Index of the oldest sample in sampleRing
+// @param sampleSum[in]      Sum of every sample in sampleRing, gives the DC offset
+// @param buffer[out]        FIXED_FFT_LENGTH values, ready for FixedFftCompute()
+void FixedFftLoadSamples(const int32_t sampleRing[FIXED_FFT_LENGTH], uint32_t oldestIndex, int64_t sampleSum,
+                         int32_t buffer[FIXED_FFT_LENGTH]);
+
+// Transform in place. On return buffer holds X[k] for k in [1, N/2) as re/im pairs,
+// with the real X[0] and X[N/2] packed into the first pair. Read it with the functions below.
+void FixedFftCompute(int32_t buffer[FIXED_FFT_LENGTH]);
+
+int64_t FixedFftBinPower(const int32_t buffer[FIXED_FFT_LENGTH], uint32_t bin);
+uint32_t FixedFftBinMagnitude(const int32_t buffer[FIXED_FFT_LENGTH], uint32_t bin);
+
+// Frequency of the strongest local peak in Q8 Hz, interpolated like RealFftMajorPeak()
+int64_t FixedFftMajorPeakQ8(const int32_t buffer[FIXED_FFT_LENGTH], uint32_t samplingFrequency);
+
+#endif // FIXED_FFT_H
@@ -1,137 +1,163 @@
 #include <Arduino.h>
-#include <esp_now.h>
 #include <FastLED.h>
+#ifndef NATIVE_BUILD
+#include <esp_now.h>
 #include <WiFi.h>
 #include <Wire.h>
+#endif
 
 #include "beat_detection.h"
+#include "compositor.h"
 #include "config.h"
 #include "effects.h"
 #include "i2s_mic.h"
 #include "interface.h"
+#include "output_stage.h"
+#include "palette.h"
+#include "radio_protocol.h"
+#include "runtime_stats.h"
+#include "spsc_ring.h"
+#include "tempo_tracker.h"
 #include "timing.h"
+#include "triple_buffer.h"
 #include "profiling.h"
 
 #define AMBIENT_EFFECT_TIMEOUT_MS 1000
 #define BEAT_EFFECT_TIMEOUT_MS 520
 
-#define PLAY_EFFECT_SEQUENCE(effect) PlayEffectSequence(effect, size(effect))
+// Audio capture and analysis run on the core shared with the WiFi stack, rendering gets the other core.
+// The audio task outranks rendering so a slow frame can never hold up an I2S read.
+#define AUDIO_TASK_CORE 0
+#define AUDIO_TASK_PRIORITY 10
+#define AUDIO_TASK_STACK_BYTES 4096
+#define RENDER_TASK_CORE 1
+#define RENDER_TASK_PRIORITY 5
+#define RENDER_TASK_STACK_BYTES 4096
+#define RENDER_FRAME_PERIOD_MS 15
+// Sends each presented frame, above rendering so it starts as soon as a frame is handed over,
+// then sleeps while the RMT interrupts feed the LEDs
+#define LED_TASK_CORE RENDER_TASK_CORE
+#define LED_TASK_PRIORITY 6
+#define LED_TASK_STACK_BYTES 2048
+// Sends trace dumps, below rendering so a slow serial write never delays a frame
+#define TRACE_TASK_CORE RENDER_TASK_CORE
+#define TRACE_TASK_PRIORITY 1
+#define TRACE_TASK_STACK_BYTES 2048
+#define TRACE_SERVICE_PERIOD_MS 100
+// Prints the runtime stats, its own row in the report shows what the printing costs
+#define STATS_TASK_CORE RENDER_TASK_CORE
+#define STATS_TASK_PRIORITY 1
+#define STATS_TASK_STACK_BYTES 3072
+
+#define BEAT_EVENT_QUEUE_LENGTH 16
+#define TEMPO_ESTIMATE_QUEUE_LENGTH 16
+
+// Above this tempo confidence beats are played when predicted rather than when detected
+#define BEAT_PREDICTION_MIN_CONFIDENCE 0.5f
+// From starting a frame to its light leaving the LEDs, about 30 us per LED of the longest strip for show()
+#define LED_OUTPUT_LATENCY_MS 5
 
 uint8_t com7Address[] = {0x0C, 0xB8, 0x15, 0xF8, 0xF6, 0x80};
 
 Colour currentColour = static_cast<Colour>(radioData.colour);
 Effect currentEffect = static_cast<Effect>(radioData.effect);
 
-static void SetEffectColour();
-static void PlayEffectSequence(effect_array_t effects_array, size_t array_size);
-static void EffectSelectionEngine();
-static void PlaySelectedEffect();
-static void PopulateRadioData(const uint8_t *esp_now_info, const uint8_t *incomingData, int data_len);
+// Beats found by the audio task, consumed by the render task
+static SpscRing<beatEvent_t, BEAT_EVENT_QUEUE_LENGTH> beatEventQueue;
+// Tempo estimate after every hop, the render task only keeps the latest
+static SpscRing<tempoEstimate_t, TEMPO_ESTIMATE_QUEUE_LENGTH> tempoEstimateQueue;
+
+// Latest controller state as received by the WiFi task. Effect commands are counted as well,
+// so one followed straight away by a colour change is not replaced before rendering sees it.
+typedef struct radioCommand_t
+{
+    radioData_t state;
+    uint32_t effectCommandCount;
+    int8_t commandedEffect;
+} radioCommand_s;
+
+// Controller packets from the WiFi task, the render task only takes the latest
+static TripleBuffer<radioCommand_t> radioMailbox;
+
+#ifndef NATIVE_BUILD
+// Sends the hat's acks back to the controller whose packet is being answered
+class EspNowReplyTransport : public RadioTransport
+{
+public:
+    const uint8_t *peerAddress = NULL;
+
+    bool Send(const uint8_t *packet, uint8_t length) override
+    {
+        if (!esp_now_is_peer_exist(peerAddress))
+        {
+            esp_now_peer_info_t peerInfo = {};
+            memcpy(peerInfo.peer_addr, peerAddress, ESP_NOW_ETH_ALEN);
+            if (esp_now_add_peer(&peerInfo) != ESP_OK)
+            {
+                return false;
+            }
+        }
+        return esp_now_send(peerAddress, packet, length) == ESP_OK;
+    }
+};
+
+// Only ever used from the WiFi task's receive callback
+static EspNowReplyTransport radioReplyTransport;
+static RadioReceiver radioReceiver(&radioReplyTransport, radioData);
+#endif
+
+static void EffectSelectionEngine(int64_t now_ms);
+static void PlaySelectedEffect(int64_t now_ms, uint32_t dt_ms);
+#ifndef NATIVE_BUILD
+static void PopulateRadioData(const uint8_t *mac_addr, const uint8_t *incomingData, int data_len);
+#endif
+static void AudioPipelineStep();
+static void RenderStep(int64_t now_ms, uint32_t dt_ms);
+static bool IsPredictedBeatDue(const tempoEstimate_t *tempo, int64_t now_ms);
 
-// for getting the length of the above effect function pointer arrays
+// for getting the length of the effect enum value arrays
 template <class T, size_t N>
 constexpr size_t size(T (&)[N])
 {
     return N;
 }
 
+#ifndef NATIVE_BUILD
 // callback function that will be executed when data is received
-static void PopulateRadioData(const uint8_t *esp_now_info, const uint8_t *incomingData, int data_len)
+static void PopulateRadioData(const uint8_t *mac_addr, const uint8_t *incomingData, int data_len)
 {
-    memcpy(&radioData, incomingData, sizeof(radioData_t));
+    // Only this task writes the mailbox, so the effect command count lives here
+    static radioCommand_t command = {radioData, 0, radioData.effect};
+    radioReplyTransport.peerAddress = mac_addr;
+    if (!radioReceiver.OnReceive(incomingData, data_len, &command.state))
+    {
+        const radioReceiverStats_t &stats = radioReceiver.Stats();
+        Serial.printf("Packet of %d bytes not applied, %u duplicate %u stale %u rejected %u resync\n",
+                      data_len, stats.duplicateCount, stats.staleCount, stats.rejectedCount, stats.resyncCount);
+        return;
+    }
+    if (command.state.isEffectCommand)
+    {
+        ++command.effectCommandCount;
+        command.commandedEffect = command.state.effect;
+    }
+    radioMailbox.Write(command);
+
     Serial.print("Bytes received: ");
     Serial.println(data_len);
     Serial.print("Effect enum: ");
-    Serial.println(radioData.effect);
+    Serial.println(command.state.effect);
     Serial.print("Colour enum: ");
-    Serial.println(radioData.colour);
+    Serial.println(command.state.colour);
     Serial.print("Ambient override: ");
-    Serial.println(radioData.ambientOverride);
+    Serial.println(command.state.ambientOverride);
     Serial.println();
 }
+#endif
 
 //-------------- Effect Control --------------
 
-// logic for selection of different colour pallettes
-static void SetEffectColour()
-{
-    switch (currentColour)
-    {
-    case Colour::red:
-        colour1 = colour2 = colour3 = CRGB::Red;
-        break;
-    case Colour::blue:
-        colour1 = colour2 = colour3 = CRGB::Blue;
-        break;
-    case Colour::green:
-        colour1 = colour2 = colour3 = CRGB::Green;
-        break;
-    case Colour::purple:
-        colour1 = colour2 = colour3 = CRGB::Purple;
-        break;
-    case Colour::white:
-        colour1 = colour2 = colour3 = CRGB::White;
-        break;
-    case Colour::yellow:
-        colour1 = colour2 = colour3 = CRGB::Yellow;
-        break;
-    case Colour::orange:
-        colour1 = colour2 = colour3 = CRGB::OrangeRed;
-        break;
-    case Colour::red_white:
-        colour1 = colour2 = CRGB::Red;
-        colour3 = CRGB::White;
-        break;
-    case Colour::green_white:
-        colour1 = colour2 = CRGB::Green;
-        colour3 = CRGB::White;
-        break;
-    case Colour::blue_white:
-        colour1 = colour2 = CRGB::Blue;
-        colour3 = CRGB::White;
-        break;
-    case Colour::cb:
-        colour1 = CRGB::OrangeRed;
-        colour2 = CRGB::Green;
-        colour3 = CRGB::Purple;
-        break;
-    case Colour::cd:
-        colour1 = CRGB::Yellow;
-        colour2 = CRGB::Blue;
-        colour3 = CRGB::Purple;
-        break;
-    case Colour::fire:
-        colour1 = CRGB::Yellow;
-        colour2 = CRGB::Red;
-        colour3 = CRGB::OrangeRed;
-        break;
-    case Colour::purue:
-        colour1 = CRGB::Purple;
-        colour2 = CRGB::Red;
-        colour3 = CRGB::Blue;
-        break;
-    case Colour::blue_red:
-        colour1 = colour2 = CRGB::Blue;
-        colour3 = CRGB::Red;
-        break;
-    }
-}
-
-static void PlayEffectSequence(effect_array_t effects_array, size_t array_size)
-{
-    static uint i = 0;
-    if (isBeatDetected)
-    {
-        i++;
-    }
-    if (!(i < array_size))
-    {
-        i = 0;
-    }
-    effects_array[i]();
-}
-
-static void EffectSelectionEngine()
+static void EffectSelectionEngine(int64_t now_ms)
 {
     static bool isAmbientSection = false;
     if (isBeatDetected && isAmbientSection)
@@ -139,7 +165,7 @@ static void EffectSelectionEngine()
         isAmbientSection = false;
         currentEffect = beatEffectEnumValues[random(size(beatEffectEnumValues))];
     }
-    else if (GetMillis() - lastBeatTime_ms > AMBIENT_EFFECT_TIMEOUT_MS && !isAmbientSection)
+    else if (now_ms - lastBeatTime_ms > AMBIENT_EFFECT_TIMEOUT_MS && !isAmbientSection)
     {
         isAmbientSection = true;
         currentEffect = ambientEffectEnumValues[random(size(ambientEffectEnumValues))];
@@ -152,75 +178,60 @@ static void EffectSelectionEngine()
 }
 
 // logic for selection of next pre-set effect
-static void PlaySelectedEffect()
+static void PlaySelectedEffect(int64_t now_ms, uint32_t dt_ms)
 {
-    switch (currentEffect)
+    const effectEvents_t events = {isBeatDetected};
+    if (!RenderLayers(currentEffect, now_ms, dt_ms, events))
     {
-    case Effect::wave_flash_double:
-        PLAY_EFFECT_SEQUENCE(wave_flash_double);
-        return;
-    case Effect::vertical_bars_clockwise:
-        PLAY_EFFECT_SEQUENCE(vertical_bars_clockwise);
-        return;
-    case Effect::wave_up:
-        PLAY_EFFECT_SEQUENCE(wave_up);
-        return;
-    case Effect::wave_down:
-        PLAY_EFFECT_SEQUENCE(wave_down);
-        return;
-    case Effect::wave_up_down:
-        PLAY_EFFECT_SEQUENCE(wave_up_down);
-        return;
-    case Effect::random_cross:
-        PLAY_EFFECT_SEQUENCE(random_cross);
-        return;
-    case Effect::horizontal_ray:
-        PLAY_EFFECT_SEQUENCE(horizontal_ray);
-        return;
-    case Effect::strobe:
-        PLAY_EFFECT_SEQUENCE(strobe_);
-        return;
-    case Effect::wave_anticlockwise:
-        PLAY_EFFECT_SEQUENCE(wave_anticlockwise);
-        return;
-    case Effect::wave_clockwise:
-        PLAY_EFFECT_SEQUENCE(wave_clockwise);
-        return;
-    case Effect::twinkle:
-        PLAY_EFFECT_SEQUENCE(twinkle_);
-        return;
-    case Effect::no_effect:
-        PLAY_EFFECT_SEQUENCE(no_effect);
-        return;
+        Serial.println("Effect not found!");
     }
-    Serial.println("Effect not found!");
 }
 
-void setup()
-{
-    Serial.begin(BAUD_RATE);
+//-------------- Pipeline --------------
 
-    // Wifi Setup
-    WiFi.mode(WIFI_STA); // Set device as a Wi-Fi Station
-    if (esp_now_init() != ESP_OK)
+// Read one hop of audio, analyse it and queue any beat found. Blocks on the I2S read.
+static void AudioPipelineStep()
+{
+    static int32_t rawMicSamples[FFT_HOP_LENGTH];
+    int64_t captureTime_us;
+    TRACE_BEGIN(TraceStage::mic_read);
+    const bool isMicDataRead = ReadMicData(rawMicSamples, &captureTime_us);
+    TRACE_END(TraceStage::mic_read);
+    if (isMicDataRead)
     {
-        Serial.println("Error initializing ESP-NOW");
-        return;
+        ComputeFFT(rawMicSamples, captureTime_us);
+        TRACE_BEGIN(TraceStage::detect);
+        beatEvent_t beatEvent;
+        if (DetectBeat(&beatEvent))
+        {
+            beatEventQueue.Push(beatEvent);
+            TRACE_INSTANT(TraceStage::beat, (uint16_t)(beatEvent.bassProportionAboveAvg * 100));
+        }
+        tempoEstimate_t tempoEstimate;
+        GetTempoEstimate(&tempoEstimate);
+        tempoEstimateQueue.Push(tempoEstimate);
+        TRACE_END(TraceStage::detect);
     }
-    esp_now_register_recv_cb(PopulateRadioData);
-
-    I2sInit();
-    FastLedInit();
-
-    SetEffectColour();
 }
 
-void loop()
+// Apply controller commands, consume queued beats and render and show one frame
+// @param now_ms    Time of this frame, the effects never read the clock themselves
+// @param dt_ms     Time since the last frame drawn
+static void RenderStep(int64_t now_ms, uint32_t dt_ms)
 {
-    if (radioData.isEffectCommand)
+    TRACE_BEGIN(TraceStage::frame);
+    // radioData is the render task's own copy of the controller state
+    static radioCommand_t command = {radioData, 0, radioData.effect};
+    static uint32_t appliedEffectCommandCount = 0;
+    if (radioMailbox.Read(&command))
+    {
+        radioData = command.state;
+        SetBeatLength(radioData.beatLength_ms);
+    }
+    if (command.effectCommandCount != appliedEffectCommandCount)
     {
-        radioData.isEffectCommand = false;
-        currentEffect = static_cast<Effect>(radioData.effect);
+        appliedEffectCommandCount = command.effectCommandCount;
+        currentEffect = static_cast<Effect>(command.commandedEffect);
     }
     else
     {
@@ -228,40 +239,190 @@ void loop()
         if (currentColour != radioDataColour)
         {
             currentColour = radioDataColour;
-            SetEffectColour();
+            SetPalette(currentColour, PALETTE_TRANSITION_MS);
         }
     }
     static uint8_t lastBrightness = radioData.brightness;
     if (radioData.brightness != lastBrightness)
     {
-        FastLED.setBrightness(radioData.brightness);
+        SetOutputBrightness(radioData.brightness);
         lastBrightness = radioData.brightness;
         Serial.println("setting new brightness");
     }
-    EMIT_PROFILING_EVENT;
-    int32_t rawMicSamples[FFT_BUFFER_LENGTH];
-    if (ReadMicData(rawMicSamples))
+
+    static tempoEstimate_t tempo = {};
+    while (tempoEstimateQueue.Pop(&tempo))
     {
-        EMIT_MIC_READ_EVENT;
-        ComputeFFT(rawMicSamples);
-        EMIT_PROFILING_EVENT;
-        DetectBeat();
-        EMIT_PROFILING_EVENT;
+    }
+    // With a confident tempo the beat is played on time, hiding the capture, FFT and show() latency.
+    // Otherwise several beats queued within one frame still only count as one beat.
+    const bool isTempoLocked = (tempo.confidence >= BEAT_PREDICTION_MIN_CONFIDENCE);
+    beatEvent_t beatEvent;
+    while (beatEventQueue.Pop(&beatEvent))
+    {
+        if (!isTempoLocked)
+        {
+            isBeatDetected = true;
+            lastBeatTime_ms = beatEvent.timestamp_ms;
+        }
+    }
+    if (isTempoLocked && IsPredictedBeatDue(&tempo, now_ms))
+    {
+        isBeatDetected = true;
+        lastBeatTime_ms = tempo.nextBeatTime_ms;
     }
     if (radioData.ambientOverride)
     {
         isBeatDetected = false;
     }
-    EffectSelectionEngine();
-    PlaySelectedEffect();
-    EMIT_PROFILING_EVENT;
-    EVERY_N_MILLIS(15)
+    TRACE_BEGIN(TraceStage::effect);
+    UpdatePalette(dt_ms);
+    EffectSelectionEngine(now_ms);
+    PlaySelectedEffect(now_ms, dt_ms);
+    TRACE_END(TraceStage::effect);
+    TRACE_BEGIN(TraceStage::show);
+    PresentFrame();
+    TRACE_END(TraceStage::show);
+    isBeatDetected = false;
+    TRACE_END(TraceStage::frame);
+}
+
+// True once per predicted beat, on the frame whose light lands closest to it
+static bool IsPredictedBeatDue(const tempoEstimate_t *tempo, int64_t now_ms)
+{
+    static int64_t lastPlayedBeatTime_ms = 0;
+    const int64_t beatPeriod_ms = (int64_t)(60000 / tempo->bpm);
+    const bool isDue = (now_ms + LED_OUTPUT_LATENCY_MS + RENDER_FRAME_PERIOD_MS / 2) >= tempo->nextBeatTime_ms;
+    const bool isNewBeat = (tempo->nextBeatTime_ms - lastPlayedBeatTime_ms) > beatPeriod_ms / 2;
+    if (isDue && isNewBeat)
     {
-        FastLED.show();
+        lastPlayedBeatTime_ms = tempo->nextBeatTime_ms;
+        return true;
     }
-    EMIT_PROFILING_EVENT;
-    isBeatDetected = false;
-#ifdef BPS_PROFILING
-    Serial.print("\n");
+    return false;
+}
+
+#ifndef NATIVE_BUILD
+static void AudioTask(void *)
+{
+    for (;;)
+    {
+        AudioPipelineStep();
+        STATS_COUNT_LOOP(StatsLoop::audio);
+    }
+}
+
+// Renders at a fixed frame rate. A frame that overruns its slot drops the frames it ran into
+// rather than rendering them back to back, the effects catch up from the longer dt.
+static void RenderTask(void *)
+{
+    const TickType_t framePeriod = pdMS_TO_TICKS(RENDER_FRAME_PERIOD_MS);
+    TickType_t lastWakeTime = xTaskGetTickCount();
+    int64_t lastFrameTime_ms = GetMillis();
+    for (;;)
+    {
+        const int64_t now_ms = GetMillis();
+        RenderStep(now_ms, (uint32_t)(now_ms - lastFrameTime_ms));
+        lastFrameTime_ms = now_ms;
+        STATS_COUNT_LOOP(StatsLoop::render);
+
+        const TickType_t lateBy = xTaskGetTickCount() - lastWakeTime;
+        if (lateBy >= framePeriod)
+        {
+            STATS_COUNT_DROPPED_FRAMES(lateBy / framePeriod);
+            lastWakeTime += (lateBy / framePeriod) * framePeriod;
+        }
+        vTaskDelayUntil(&lastWakeTime, framePeriod);
+    }
+}
+
+static void LedTask(void *)
+{
+    for (;;)
+    {
+        TransmitFrame();
+    }
+}
+
+#ifdef TRACE_ENABLED
+static void TraceTask(void *)
+{
+    for (;;)
+    {
+        TraceService();
+        vTaskDelay(pdMS_TO_TICKS(TRACE_SERVICE_PERIOD_MS));
+    }
+}
+#endif
+
+#ifdef RUNTIME_STATS_ENABLED
+static void StatsTask(void *)
+{
+    TickType_t lastWakeTime = xTaskGetTickCount();
+    for (;;)
+    {
+        RuntimeStatsReport();
+        vTaskDelayUntil(&lastWakeTime, pdMS_TO_TICKS(RUNTIME_STATS_PERIOD_MS));
+    }
+}
+#endif
+#endif
+
+void setup()
+{
+    Serial.begin(BAUD_RATE);
+
+#ifndef NATIVE_BUILD
+    // Wifi Setup
+    WiFi.mode(WIFI_STA); // Set device as a Wi-Fi Station
+    if (esp_now_init() != ESP_OK)
+    {
+        Serial.println("Error initializing ESP-NOW");
+        return;
+    }
+    esp_now_register_recv_cb(PopulateRadioData);
+#endif
+
+    I2sInit();
+    BeatDetectionInit();
+    FastLedInit();
+
+    PaletteInit(currentColour);
+
+#ifndef NATIVE_BUILD
+#ifdef RUNTIME_STATS_ENABLED
+    RuntimeStatsInit();
 #endif
+    xTaskCreatePinnedToCore(AudioTask, "audio", AUDIO_TASK_STACK_BYTES, NULL, AUDIO_TASK_PRIORITY, NULL, AUDIO_TASK_CORE);
+    xTaskCreatePinnedToCore(LedTask, "led", LED_TASK_STACK_BYTES, NULL, LED_TASK_PRIORITY, NULL, LED_TASK_CORE);
+    xTaskCreatePinnedToCore(RenderTask, "render", RENDER_TASK_STACK_BYTES, NULL, RENDER_TASK_PRIORITY, NULL, RENDER_TASK_CORE);
+#ifdef TRACE_ENABLED
+    xTaskCreatePinnedToCore(TraceTask, "trace", TRACE_TASK_STACK_BYTES, NULL, TRACE_TASK_PRIORITY, NULL, TRACE_TASK_CORE);
+#endif
+#ifdef RUNTIME_STATS_ENABLED
+    xTaskCreatePinnedToCore(StatsTask, "stats", STATS_TASK_STACK_BYTES, NULL, STATS_TASK_PRIORITY, NULL, STATS_TASK_CORE);
+#endif
+#endif
+}
+
+#ifdef NATIVE_BUILD
+// Interleave the two tasks on the simulated clock: each audio frame advances time,
+// then every render frame that would have fallen due in that time is drawn. Frames are
+// drawn at their due times, so a run over the same audio always draws the same frames.
+void loop()
+{
+    static int64_t nextRenderTime_ms = 0;
+    AudioPipelineStep();
+    while (GetMillis() >= nextRenderTime_ms)
+    {
+        RenderStep(nextRenderTime_ms, RENDER_FRAME_PERIOD_MS);
+        nextRenderTime_ms += RENDER_FRAME_PERIOD_MS;
+    }
 }
+#else
+// All the work happens in the pinned tasks created in setup()
+void loop()
+{
+    vTaskDelete(NULL);
+}
+#endif
@@ -1,12 +1,23 @@
 #include "i2s_mic.h"
 #include "driver/i2s.h"
-#include "profiling.h"
+
+#include <atomic>
+
+#include "timing.h"
 
 #define I2S_MIC_CHANNEL I2S_CHANNEL_FMT_ONLY_RIGHT
 #define I2S_MIC_SERIAL_CLOCK GPIO_NUM_32
 #define I2S_MIC_LEFT_RIGHT_CLOCK GPIO_NUM_25
 #define I2S_MIC_SERIAL_DATA GPIO_NUM_33
 
+// Events queued between two reads, about one per DMA buffer
+#define I2S_EVENT_QUEUE_LENGTH (2 * I2S_DMA_BUFFER_COUNT)
+// How far the capture clock estimate relaxes each hop, so it follows any drift between the
+// I2S and CPU clocks. 1 us a hop allows about 190 ppm.
+#define CAPTURE_CLOCK_RELAX_US_PER_HOP 1
+
+#define SAMPLES_TO_MICROS(count) ((int64_t)(count) * 1000000 / SAMPLING_FREQUENCY_HZ)
+
 static i2s_config_t i2s_config = {
     .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX),
     .sample_rate = SAMPLING_FREQUENCY_HZ,
@@ -14,8 +25,8 @@ static i2s_config_t i2s_config = {
     .channel_format = I2S_MIC_CHANNEL,
     .communication_format = I2S_COMM_FORMAT_STAND_I2S,
     .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-    .dma_buf_count = 2,
-    .dma_buf_len = FFT_BUFFER_LENGTH,
+    .dma_buf_count = I2S_DMA_BUFFER_COUNT,
+    .dma_buf_len = I2S_DMA_BUFFER_LENGTH,
     .use_apll = false,
     .tx_desc_auto_clear = false,
     .fixed_mclk = 0};
@@ -27,19 +38,113 @@ static i2s_pin_config_t i2s_mic_pins = {
     .data_in_num = I2S_MIC_SERIAL_DATA
 };
 
+static QueueHandle_t i2sEventQueue = NULL;
+
+// Index one past the last sample read, counting the dropped ones so it stays in step with the mic
+static uint64_t nextSampleIndex = 0;
+// Estimated time sample 0 was captured. Every read lands some time after its last sample was
+// captured, so the earliest the sample count puts sample 0 at is the best estimate.
+static int64_t sampleZeroTime_us = 0;
+static bool isCaptureClockStarted = false;
+
+// Written by the audio task only, GetMicStats() reports the change since it last ran
+static std::atomic<uint32_t> hopCount(0);
+static std::atomic<uint32_t> overrunCount(0);
+static std::atomic<uint32_t> shortReadCount(0);
+static std::atomic<uint32_t> latencySum_us(0);
+static std::atomic<uint32_t> maxLatency_us(0);
+static std::atomic<uint64_t> sampleCount(0);
+
+static void DrainI2sEvents();
+static int64_t CaptureTimeOfLastSample(int64_t readTime_us);
+
 void I2sInit()
 {
-    i2s_driver_install(I2S_NUM_0, &i2s_config, 0, NULL);
+    i2s_driver_install(I2S_NUM_0, &i2s_config, I2S_EVENT_QUEUE_LENGTH, &i2sEventQueue);
     i2s_set_pin(I2S_NUM_0, &i2s_mic_pins);
 }
 
-// Return true if read FFT_BUFFER_LENGTH samples
+// Return true if read FFT_HOP_LENGTH samples
 // @param rawMicSamples[out]    Output buffer to store samples from mic in
-bool ReadMicData(int32_t rawMicSamples[FFT_BUFFER_LENGTH])
+// @param captureTime_us[out]   When the last of them was captured, from the running sample count
+bool ReadMicData(int32_t rawMicSamples[FFT_HOP_LENGTH], int64_t *captureTime_us)
 {
     size_t bytes_read = 0;
-    i2s_read(I2S_NUM_0, rawMicSamples, sizeof(int32_t) * FFT_BUFFER_LENGTH, &bytes_read, portMAX_DELAY);
-    const bool successfullyReadAllSamples = (bytes_read / sizeof(int32_t) == FFT_BUFFER_LENGTH);
-    EMIT_PROFILING_EVENT;
+    i2s_read(I2S_NUM_0, rawMicSamples, sizeof(int32_t) * FFT_HOP_LENGTH, &bytes_read, portMAX_DELAY);
+    const int64_t readTime_us = GetMicros();
+    // Overruns lost audio from before this read, so they move the sample count on first
+    DrainI2sEvents();
+
+    const uint32_t samplesRead = bytes_read / sizeof(int32_t);
+    nextSampleIndex += samplesRead;
+    sampleCount.store(nextSampleIndex, std::memory_order_relaxed);
+    *captureTime_us = CaptureTimeOfLastSample(readTime_us);
+
+    const uint32_t latency_us = (uint32_t)(readTime_us - *captureTime_us);
+    latencySum_us.fetch_add(latency_us, std::memory_order_relaxed);
+    if (latency_us > maxLatency_us.load(std::memory_order_relaxed))
+    {
+        maxLatency_us.store(latency_us, std::memory_order_relaxed);
+    }
+    hopCount.fetch_add(1, std::memory_order_relaxed);
+
+    const bool successfullyReadAllSamples = (samplesRead == FFT_HOP_LENGTH);
+    if (!successfullyReadAllSamples)
+    {
+        shortReadCount.fetch_add(1, std::memory_order_relaxed);
+    }
     return successfullyReadAllSamples;
-}
\ No newline at end of file
+}
+
+void GetMicStats(micStats_t *stats)
+{
+    static uint32_t lastHopCount = 0;
+    static uint32_t lastOverrunCount = 0;
+    static uint32_t lastShortReadCount = 0;
+    static uint32_t lastLatencySum_us = 0;
+
+    const uint32_t hops = hopCount.load(std::memory_order_relaxed);
+    const uint32_t overruns = overrunCount.load(std::memory_order_relaxed);
+    const uint32_t shortReads = shortReadCount.load(std::memory_order_relaxed);
+    const uint32_t latencySum = latencySum_us.load(std::memory_order_relaxed);
+    stats->hopCount = hops - lastHopCount;
+    stats->overrunCount = overruns - lastOverrunCount;
+    stats->droppedSampleCount = stats->overrunCount * I2S_DMA_BUFFER_LENGTH;
+    stats->shortReadCount = shortReads - lastShortReadCount;
+    stats->meanLatency_us = (stats->hopCount > 0) ? (latencySum - lastLatencySum_us) / stats->hopCount : 0;
+    stats->maxLatency_us = maxLatency_us.exchange(0, std::memory_order_relaxed);
+    stats->sampleCount = sampleCount.load(std::memory_order_relaxed);
+
+    lastHopCount = hops;
+    lastOverrunCount = overruns;
+    lastShortReadCount = shortReads;
+    lastLatencySum_us = latencySum;
+}
+
+// Count the DMA buffers the driver threw away because they were not read in time
+static void DrainI2sEvents()
+{
+    i2s_event_t event;
+    while (xQueueReceive(i2sEventQueue, &event, 0) == pdTRUE)
+    {
+        if (event.type == I2S_EVENT_RX_Q_OVF)
+        {
+            nextSampleIndex += I2S_DMA_BUFFER_LENGTH;
+            overrunCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+// Place the last sample read on the CPU clock, given when the read returned
+static int64_t CaptureTimeOfLastSample(int64_t readTime_us)
+{
+    const int64_t lastSampleIndex = (int64_t)nextSampleIndex - 1;
+    const int64_t impliedSampleZeroTime_us = readTime_us - SAMPLES_TO_MICROS(lastSampleIndex);
+    sampleZeroTime_us += CAPTURE_CLOCK_RELAX_US_PER_HOP;
+    if (!isCaptureClockStarted || impliedSampleZeroTime_us < sampleZeroTime_us)
+    {
+        sampleZeroTime_us = impliedSampleZeroTime_us;
+        isCaptureClockStarted = true;
+    }
+    return sampleZeroTime_us + SAMPLES_TO_MICROS(lastSampleIndex);
+}
@@ -1,11 +1,33 @@
 #ifndef I2S_MIC_H
 #define I2S_MIC_H
 
-#include "driver/i2s.h"
 #include "beat_detection.h"
 
+// DMA buffers the I2S driver captures into, each one hop long. Reads may fall this many
+// hops behind before audio is lost, at 5.3 ms a hop with the default hop length.
+#define I2S_DMA_BUFFER_COUNT 8
+#define I2S_DMA_BUFFER_LENGTH FFT_HOP_LENGTH
+
+// Capture health since the last GetMicStats() call, except where noted
+typedef struct micStats_t
+{
+    uint32_t hopCount;
+    uint32_t overrunCount;       // DMA buffers overwritten before they were read
+    uint32_t droppedSampleCount; // Samples lost to those overruns
+    uint32_t shortReadCount;     // Reads that returned less than a hop
+    uint32_t meanLatency_us;     // From capturing a hop's last sample to reading it
+    uint32_t maxLatency_us;
+    uint64_t sampleCount;        // Every sample since I2sInit(), read or dropped
+} micStats_s;
 
-bool ReadMicData(int32_t rawMicSamples[FFT_BUFFER_LENGTH]);
 void I2sInit();
 
-#endif // I2S_MIC_H
\ No newline at end of file
+// Return true if read FFT_HOP_LENGTH samples
+// @param rawMicSamples[out]    Output buffer to store samples from mic in
+// @param captureTime_us[out]   When the last of them was captured, from the running sample count
+bool ReadMicData(int32_t rawMicSamples[FFT_HOP_LENGTH], int64_t *captureTime_us);
+
+// Safe to call from any task, the audio task keeps capturing meanwhile
+void GetMicStats(micStats_t *stats);
+
+#endif // I2S_MIC_H
@@ -48,7 +48,7 @@ enum class Effect : int8_t
     no_effect = 30,
 };
 
-const Effect beatEffectEnumValues[] = {
+constexpr Effect beatEffectEnumValues[] = {
     Effect::wave_flash_double,
     Effect::vertical_bars_clockwise,
     Effect::wave_up,
@@ -57,12 +57,13 @@ const Effect beatEffectEnumValues[] = {
     Effect::random_cross,
     Effect::horizontal_ray,
 };
-const Effect ambientEffectEnumValues[] = {
+constexpr Effect ambientEffectEnumValues[] = {
     Effect::wave_anticlockwise,
     Effect::wave_clockwise,
     Effect::twinkle,
 };
 
+// Controller state, sent as radio_protocol.h packets rather than as this struct
 typedef struct radioData_t
 {
     bool isEffectCommand;
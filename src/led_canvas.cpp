@@ -0,0 +1,35 @@
+#include "led_canvas.h"
+
+static uint32_t fadeSkippedLedCount = 0;
+
+static bool IsBlack(const CRGB &pixel)
+{
+    return (pixel.r | pixel.g | pixel.b) == 0;
+}
+
+void ClearCanvas(ledCanvas_t *canvas)
+{
+    fill_solid(canvas->pixels, NUM_LEDS, CRGB::Black);
+    canvas->litFirst = 0;
+    canvas->litEnd = 0;
+}
+
+void FadeCanvas(ledCanvas_t *canvas, uint8_t fadeBy)
+{
+    fadeSkippedLedCount += NUM_LEDS - (canvas->litEnd - canvas->litFirst);
+    fadeToBlackBy(&canvas->pixels[canvas->litFirst], canvas->litEnd - canvas->litFirst, fadeBy);
+    // Then trim the black off each end, which stops at the first lit LED from either side
+    while (canvas->litFirst < canvas->litEnd && IsBlack(canvas->pixels[canvas->litFirst]))
+    {
+        ++canvas->litFirst;
+    }
+    while (canvas->litEnd > canvas->litFirst && IsBlack(canvas->pixels[canvas->litEnd - 1]))
+    {
+        --canvas->litEnd;
+    }
+}
+
+uint32_t FadeSkippedLedCount()
+{
+    return fadeSkippedLedCount;
+}
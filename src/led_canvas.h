@@ -0,0 +1,56 @@
+#ifndef LED_CANVAS_H
+#define LED_CANVAS_H
+
+#include <FastLED.h>
+
+#include "config.h"
+#include "led_geometry.h"
+
+// A frame effects draw on. It also keeps the span of LEDs that may be lit, widened by every
+// draw and narrowed by every fade, so fades and blends can pass over the LEDs known to be
+// black. Draw through SetPixel() or mark what was drawn with MarkLit().
+typedef struct ledCanvas_t
+{
+    CRGB pixels[NUM_LEDS];
+    uint16_t litFirst;
+    uint16_t litEnd; // One past the last, the same as litFirst when every LED is black
+} ledCanvas_s;
+
+inline bool IsCanvasBlack(const ledCanvas_t *canvas)
+{
+    return canvas->litFirst == canvas->litEnd;
+}
+
+inline ledSpan_t LitSpan(const ledCanvas_t *canvas)
+{
+    return {canvas->litFirst, (uint16_t)(canvas->litEnd - canvas->litFirst)};
+}
+
+inline void MarkLit(ledCanvas_t *canvas, const ledSpan_t &span)
+{
+    const uint16_t end = span.first + span.length;
+    if (IsCanvasBlack(canvas))
+    {
+        canvas->litFirst = span.first;
+        canvas->litEnd = end;
+        return;
+    }
+    canvas->litFirst = (span.first < canvas->litFirst) ? span.first : canvas->litFirst;
+    canvas->litEnd = (end > canvas->litEnd) ? end : canvas->litEnd;
+}
+
+inline void SetPixel(ledCanvas_t *canvas, uint16_t index, const CRGB &colour)
+{
+    canvas->pixels[index] = colour;
+    MarkLit(canvas, {index, 1});
+}
+
+void ClearCanvas(ledCanvas_t *canvas);
+
+// fadeToBlackBy() over the lit span, which then shrinks to the LEDs still lit
+void FadeCanvas(ledCanvas_t *canvas, uint8_t fadeBy);
+
+// LEDs fades passed over as already black, since boot
+uint32_t FadeSkippedLedCount();
+
+#endif // LED_CANVAS_H
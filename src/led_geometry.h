@@ -0,0 +1,118 @@
+#ifndef LED_GEOMETRY_H
+#define LED_GEOMETRY_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+// Layout of the LED matrix around the hat, worked out at compile time. x runs around the
+// hat's circumference and wraps, y runs up it. Effects look LED indices up in the tables
+// below instead of computing them per pixel.
+//
+// The rows can be split between several strips, each on its own data pin, bottom rows on
+// the first. Every strip is a contiguous block of the frame, so it is sent straight from
+// there, and its wiring starts afresh at its own first row.
+
+enum class LedWiring : uint8_t
+{
+    progressive, // Every row runs the same way
+    serpentine,  // Rows alternate direction, the even ones run with x
+};
+
+// A run of LEDs that sit next to each other on the strip, such as one row
+typedef struct ledSpan_t
+{
+    uint16_t first;
+    uint16_t length;
+} ledSpan_s;
+
+template <uint16_t WIDTH, uint16_t HEIGHT>
+struct ledTables_t
+{
+    uint16_t index[HEIGHT][WIDTH];
+    uint16_t column[WIDTH][HEIGHT];
+};
+
+// Rows on each strip, all but the last strip are full
+constexpr uint16_t RowsPerStrip(uint16_t height, uint16_t strips)
+{
+    return (height + strips - 1) / strips;
+}
+
+template <uint16_t WIDTH, uint16_t HEIGHT, LedWiring WIRING, uint16_t STRIPS>
+constexpr ledTables_t<WIDTH, HEIGHT> BuildLedTables()
+{
+    ledTables_t<WIDTH, HEIGHT> tables = {};
+    for (uint16_t y = 0; y < HEIGHT; ++y)
+    {
+        const uint16_t rowOnStrip = y % RowsPerStrip(HEIGHT, STRIPS);
+        const bool isReversed = (WIRING == LedWiring::serpentine) && (rowOnStrip % 2 != 0);
+        for (uint16_t x = 0; x < WIDTH; ++x)
+        {
+            const uint16_t index = y * WIDTH + (isReversed ? (WIDTH - 1 - x) : x);
+            tables.index[y][x] = index;
+            tables.column[x][y] = index;
+        }
+    }
+    return tables;
+}
+
+template <uint16_t WIDTH, uint16_t HEIGHT, LedWiring WIRING, uint16_t STRIPS>
+class LedGeometry
+{
+    static_assert(WIDTH > 0 && HEIGHT > 0, "LED matrix needs at least one LED");
+    static_assert((uint32_t)WIDTH * HEIGHT <= UINT16_MAX, "LED indices must fit in 16 bits");
+    static_assert(STRIPS > 0 && (STRIPS - 1) * RowsPerStrip(HEIGHT, STRIPS) < HEIGHT, "Every strip needs at least one row");
+
+public:
+    static constexpr uint16_t width = WIDTH;
+    static constexpr uint16_t height = HEIGHT;
+    static constexpr uint16_t ledCount = WIDTH * HEIGHT;
+    static constexpr uint16_t stripCount = STRIPS;
+    static constexpr uint16_t rowsPerStrip = RowsPerStrip(HEIGHT, STRIPS);
+
+    // Column x wrapped around the hat, for x no more than one width either side of it
+    static constexpr uint16_t WrapX(int x)
+    {
+        return (x < 0) ? (uint16_t)(x + WIDTH) : (x >= WIDTH) ? (uint16_t)(x - WIDTH) : (uint16_t)x;
+    }
+
+    // LED index of a wrapped x and a y in range
+    static constexpr uint16_t Index(uint16_t x, uint16_t y)
+    {
+        return tables.index[y][x];
+    }
+
+    // Indices of the column's LEDs from the bottom row up
+    static constexpr const uint16_t (&Column(uint16_t x))[HEIGHT]
+    {
+        return tables.column[x];
+    }
+
+    // Smallest run of the strip holding every LED of the column
+    static constexpr ledSpan_t ColumnSpan(uint16_t x)
+    {
+        return {Index(x, 0), (uint16_t)(Index(x, HEIGHT - 1) - Index(x, 0) + 1)};
+    }
+
+    // Every row is one contiguous run of the strip, whichever way it is wired
+    static constexpr ledSpan_t Row(uint16_t y)
+    {
+        return {(uint16_t)(y * WIDTH), WIDTH};
+    }
+
+    // The LEDs one strip drives, its whole length in the order it is wired
+    static constexpr ledSpan_t Strip(uint16_t strip)
+    {
+        const uint16_t firstRow = strip * rowsPerStrip;
+        const uint16_t rows = (HEIGHT - firstRow < rowsPerStrip) ? (HEIGHT - firstRow) : rowsPerStrip;
+        return {(uint16_t)(firstRow * WIDTH), (uint16_t)(rows * WIDTH)};
+    }
+
+private:
+    static constexpr ledTables_t<WIDTH, HEIGHT> tables = BuildLedTables<WIDTH, HEIGHT, WIRING, STRIPS>();
+};
+
+typedef LedGeometry<NUMBER_X_LEDS, NUMBER_Y_LEDS, LED_WIRING, LED_STRIP_COUNT> HatGeometry;
+
+#endif // LED_GEOMETRY_H
@@ -0,0 +1,76 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Minimal stand-in for the Arduino core, only built by env:native.
+// Provides just what the hat sources use, with millis()/micros() on the simulated clock.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "native_hal.h"
+
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define DEC 10
+
+inline unsigned long millis(void)
+{
+    return (unsigned long)(NativeClockMicros() / 1000);
+}
+
+inline unsigned long micros(void)
+{
+    return (unsigned long)NativeClockMicros();
+}
+
+// Nothing to wait for, time only moves with the audio
+inline void delay(unsigned long)
+{
+}
+
+// Fixed seed so effect choices are reproducible between runs
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+
+// Serial output goes to stderr so stdout stays free for tooling
+class NativeSerial
+{
+public:
+    void begin(unsigned long) {}
+    // Nothing is ever received on the host
+    int available() { return 0; }
+    int read() { return -1; }
+    size_t write(const uint8_t *bytes, size_t length) { return fwrite(bytes, 1, length, stderr); }
+    size_t print(const char *value) { return fprintf(stderr, "%s", value); }
+    size_t print(char value) { return fprintf(stderr, "%c", value); }
+    size_t print(int value, int = DEC) { return fprintf(stderr, "%d", value); }
+    size_t print(unsigned int value, int = DEC) { return fprintf(stderr, "%u", value); }
+    size_t print(long value, int = DEC) { return fprintf(stderr, "%ld", value); }
+    size_t print(unsigned long value, int = DEC) { return fprintf(stderr, "%lu", value); }
+    size_t print(long long value, int = DEC) { return fprintf(stderr, "%lld", value); }
+    size_t print(unsigned long long value, int = DEC) { return fprintf(stderr, "%llu", value); }
+    size_t print(double value, int digits = 2) { return fprintf(stderr, "%.*f", digits, value); }
+    size_t println() { return fprintf(stderr, "\n"); }
+    template <typename T>
+    size_t println(T value)
+    {
+        return print(value) + println();
+    }
+    template <typename T>
+    size_t println(T value, int format)
+    {
+        return print(value, format) + println();
+    }
+};
+
+extern NativeSerial Serial;
+
+#endif // NATIVE_ARDUINO_H
@@ -0,0 +1,195 @@
+#ifndef NATIVE_FASTLED_H
+#define NATIVE_FASTLED_H
+
+// Minimal stand-in for FastLED, only built by env:native.
+// Colour maths follows FastLED (scale8 with FASTLED_SCALE8_FIXED) so frames match the
+// hat, and show() writes the frame to the native frame file instead of a data pin.
+
+#include "Arduino.h"
+
+#define FASTLED_NATIVE_MAX_CONTROLLERS 8
+#define DISABLE_DITHER 0x00
+#define BINARY_DITHER 0x01
+
+inline uint8_t scale8(uint8_t i, uint8_t scale)
+{
+    return (uint8_t)(((uint16_t)i * (1 + (uint16_t)scale)) >> 8);
+}
+
+struct CRGB
+{
+    union
+    {
+        struct
+        {
+            uint8_t r;
+            uint8_t g;
+            uint8_t b;
+        };
+        uint8_t raw[3];
+    };
+
+    typedef enum : uint32_t
+    {
+        Black = 0x000000,
+        Blue = 0x0000FF,
+        Green = 0x008000,
+        OrangeRed = 0xFF4500,
+        Purple = 0x800080,
+        Red = 0xFF0000,
+        White = 0xFFFFFF,
+        Yellow = 0xFFFF00,
+    } HTMLColorCode;
+
+    CRGB() = default;
+    constexpr CRGB(uint8_t ir, uint8_t ig, uint8_t ib) : r(ir), g(ig), b(ib) {}
+    constexpr CRGB(uint32_t colorcode)
+        : r((colorcode >> 16) & 0xFF), g((colorcode >> 8) & 0xFF), b(colorcode & 0xFF) {}
+    constexpr CRGB(HTMLColorCode colorcode) : CRGB((uint32_t)colorcode) {}
+
+    CRGB &nscale8(uint8_t scale)
+    {
+        r = scale8(r, scale);
+        g = scale8(g, scale);
+        b = scale8(b, scale);
+        return *this;
+    }
+
+    bool operator==(const CRGB &other) const
+    {
+        return (r == other.r) && (g == other.g) && (b == other.b);
+    }
+    bool operator!=(const CRGB &other) const
+    {
+        return !(*this == other);
+    }
+};
+
+inline void fadeToBlackBy(CRGB *leds, uint16_t numLeds, uint8_t fadeBy)
+{
+    for (uint16_t i = 0; i < numLeds; ++i)
+    {
+        leds[i].nscale8(255 - fadeBy);
+    }
+}
+
+inline void fill_solid(CRGB *leds, int numLeds, const CRGB &colour)
+{
+    for (int i = 0; i < numLeds; ++i)
+    {
+        leds[i] = colour;
+    }
+}
+
+// ----- Timed blocks -----
+
+class CEveryNMillis
+{
+public:
+    explicit CEveryNMillis(uint32_t period) : mPeriod(period), mPrevTrigger(millis()) {}
+    bool ready()
+    {
+        const uint32_t now = millis();
+        if (now - mPrevTrigger >= mPeriod)
+        {
+            mPrevTrigger = now;
+            return true;
+        }
+        return false;
+    }
+    operator bool() { return ready(); }
+
+private:
+    uint32_t mPeriod;
+    uint32_t mPrevTrigger;
+};
+
+#define FASTLED_NATIVE_CONCAT_INNER(a, b) a##b
+#define FASTLED_NATIVE_CONCAT(a, b) FASTLED_NATIVE_CONCAT_INNER(a, b)
+#define EVERY_N_MILLIS_I(NAME, N) static CEveryNMillis NAME(N); if (NAME)
+#define EVERY_N_MILLIS(N) EVERY_N_MILLIS_I(FASTLED_NATIVE_CONCAT(PER, __COUNTER__), N)
+#define EVERY_N_MILLISECONDS(N) EVERY_N_MILLIS(N)
+
+// ----- Controllers -----
+
+enum EOrder
+{
+    RGB = 0012,
+    GRB = 0102,
+};
+
+template <uint8_t DATA_PIN, EOrder RGB_ORDER>
+class WS2812B
+{
+};
+
+class CLEDController
+{
+public:
+    CLEDController &setLeds(CRGB *data, int numLeds)
+    {
+        mLeds = data;
+        mNumLeds = numLeds;
+        return *this;
+    }
+    CRGB *leds() { return mLeds; }
+    int size() const { return mNumLeds; }
+    uint8_t pin() const { return mPin; }
+    void setPin(uint8_t pin) { mPin = pin; }
+
+private:
+    CRGB *mLeds = nullptr;
+    int mNumLeds = 0;
+    uint8_t mPin = 0;
+};
+
+class CFastLED
+{
+public:
+    template <template <uint8_t DATA_PIN, EOrder RGB_ORDER> class CHIPSET, uint8_t DATA_PIN, EOrder RGB_ORDER>
+    CLEDController &addLeds(CRGB *data, int numLeds)
+    {
+        CLEDController &controller = mControllers[mNumControllers < FASTLED_NATIVE_MAX_CONTROLLERS ? mNumControllers++ : 0];
+        controller.setPin(DATA_PIN);
+        return controller.setLeds(data, numLeds);
+    }
+
+    CLEDController &operator[](int index) { return mControllers[index]; }
+    int count() const { return mNumControllers; }
+
+    void setBrightness(uint8_t brightness) { mBrightness = brightness; }
+    uint8_t getBrightness() const { return mBrightness; }
+    // Frames are written once, so there is nothing to dither between
+    void setDither(uint8_t) {}
+
+    // All controllers are written as one frame in controller order
+    void show()
+    {
+        static uint8_t frame[3 * UINT16_MAX];
+        uint16_t numLeds = 0;
+        for (int c = 0; c < mNumControllers; ++c)
+        {
+            const int count = mControllers[c].size();
+            memcpy(&frame[3 * numLeds], mControllers[c].leds(), 3 * count);
+            numLeds += count;
+        }
+        NativeLedWriteFrame(frame, numLeds, mBrightness);
+    }
+
+    void clear()
+    {
+        for (int c = 0; c < mNumControllers; ++c)
+        {
+            memset(mControllers[c].leds(), 0, sizeof(CRGB) * mControllers[c].size());
+        }
+    }
+
+private:
+    CLEDController mControllers[FASTLED_NATIVE_MAX_CONTROLLERS];
+    int mNumControllers = 0;
+    uint8_t mBrightness = 255;
+};
+
+extern CFastLED FastLED;
+
+#endif // NATIVE_FASTLED_H
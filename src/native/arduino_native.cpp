@@ -0,0 +1,37 @@
+#include "Arduino.h"
+
+NativeSerial Serial;
+
+static uint32_t randomState = 0x2545F491u;
+
+// xorshift32, plenty for picking effects and pixels
+static uint32_t NextRandom()
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+long random(long howBig)
+{
+    if (howBig <= 0)
+    {
+        return 0;
+    }
+    return (long)(NextRandom() % (uint32_t)howBig);
+}
+
+long random(long howSmall, long howBig)
+{
+    if (howSmall >= howBig)
+    {
+        return howSmall;
+    }
+    return howSmall + random(howBig - howSmall);
+}
+
+void randomSeed(unsigned long seed)
+{
+    randomState = (seed != 0) ? (uint32_t)seed : 0x2545F491u;
+}
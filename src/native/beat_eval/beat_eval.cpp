@@ -0,0 +1,166 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "beat_detection.h"
+#include "eval_clips.h"
+#include "i2s_mic.h"
+#include "native_hal.h"
+
+// Host entry point for env:beat_eval. Runs ComputeFFT() and DetectBeat() over the synthetic
+// corpus plus any annotated audio files given, and scores the detections against the beats.
+// Usage: program [-f minFMeasure] [clip.wav ...], each clip.wav needs a clip.wav.beats file.
+// Exits with 1 if the overall F-measure is below minFMeasure, or if a clip cannot be loaded.
+
+// A detection this close to a beat counts as finding it, as in mir_eval's beat F-measure
+#define BEAT_EVAL_TOLERANCE_S 0.07
+
+typedef struct clipScore_t
+{
+    uint32_t beatCount;
+    uint32_t detectionCount;
+    uint32_t hitCount;
+    double offsetSum_s;
+    // Largest offset from a found beat, signed, detections are late when positive
+    double worstOffset_s;
+} clipScore_s;
+
+static bool DetectClipBeats(const evalClip_t *clip, std::vector<double> *detectionTimes_s);
+static void ScoreClip(const std::vector<double> &beatTimes_s, const std::vector<double> &detectionTimes_s, clipScore_t *score);
+static void PrintScore(const char *name, const clipScore_t *score);
+static double FMeasure(const clipScore_t *score);
+
+int main(int argc, char *argv[])
+{
+    double minFMeasure = 0;
+    std::vector<evalClip_t> clips;
+    BuildSyntheticClips(&clips);
+    for (int arg = 1; arg < argc; ++arg)
+    {
+        if (strcmp(argv[arg], "-f") == 0 && arg + 1 < argc)
+        {
+            minFMeasure = atof(argv[++arg]);
+            continue;
+        }
+        evalClip_t clip;
+        if (!LoadAnnotatedClip(argv[arg], &clip))
+        {
+            return 1;
+        }
+        clips.push_back(clip);
+    }
+
+    printf("Backend %d, detector %d, window %d, hop %d, decimation %d\n",
+           BEAT_DETECTION_BACKEND, BEAT_DETECTOR, FFT_BUFFER_LENGTH, FFT_HOP_LENGTH, AUDIO_DECIMATION_FACTOR);
+    printf("%-24s %6s %6s %6s %6s %6s %6s %9s %9s\n", "clip", "beats", "found", "false", "P", "R", "F", "mean ms", "worst ms");
+
+    clipScore_t total = {};
+    for (const evalClip_t &clip : clips)
+    {
+        std::vector<double> detectionTimes_s;
+        if (!DetectClipBeats(&clip, &detectionTimes_s))
+        {
+            fprintf(stderr, "Could not load the audio of %s\n", clip.name.c_str());
+            return 1;
+        }
+        clipScore_t score = {};
+        ScoreClip(clip.beatTimes_s, detectionTimes_s, &score);
+        PrintScore(clip.name.c_str(), &score);
+
+        total.beatCount += score.beatCount;
+        total.detectionCount += score.detectionCount;
+        total.hitCount += score.hitCount;
+        total.offsetSum_s += score.offsetSum_s;
+        if (fabs(score.worstOffset_s) > fabs(total.worstOffset_s))
+        {
+            total.worstOffset_s = score.worstOffset_s;
+        }
+    }
+    PrintScore("overall", &total);
+
+    if (FMeasure(&total) < minFMeasure)
+    {
+        printf("F-measure %.3f is below %.3f\n", FMeasure(&total), minFMeasure);
+        return 1;
+    }
+    return 0;
+}
+
+// Returns false if the clip's audio could not be opened, rather than scoring it as all misses
+static bool DetectClipBeats(const evalClip_t *clip, std::vector<double> *detectionTimes_s)
+{
+    const bool isOpen = clip->samples.empty() ? NativeHalInit(clip->audioPath.c_str(), NULL)
+                                              : NativeHalInitSamples(clip->samples.data(), clip->samples.size());
+    if (!isOpen)
+    {
+        return false;
+    }
+    BeatDetectionInit();
+    static int32_t rawMicSamples[FFT_HOP_LENGTH];
+    while (!NativeAudioIsExhausted())
+    {
+        int64_t captureTime_us;
+        if (ReadMicData(rawMicSamples, &captureTime_us))
+        {
+            ComputeFFT(rawMicSamples, captureTime_us);
+            beatEvent_t beatEvent;
+            if (DetectBeat(&beatEvent))
+            {
+                detectionTimes_s->push_back(beatEvent.timestamp_ms / 1000.0);
+            }
+        }
+    }
+    NativeHalShutdown();
+    return true;
+}
+
+// Match every beat to the earliest unused detection within BEAT_EVAL_TOLERANCE_S of it.
+// Both lists are in time order.
+static void ScoreClip(const std::vector<double> &beatTimes_s, const std::vector<double> &detectionTimes_s, clipScore_t *score)
+{
+    score->beatCount = beatTimes_s.size();
+    score->detectionCount = detectionTimes_s.size();
+    size_t nextDetection = 0;
+    for (const double beatTime_s : beatTimes_s)
+    {
+        while (nextDetection < detectionTimes_s.size() && detectionTimes_s[nextDetection] < beatTime_s - BEAT_EVAL_TOLERANCE_S)
+        {
+            ++nextDetection;
+        }
+        if (nextDetection < detectionTimes_s.size() && detectionTimes_s[nextDetection] <= beatTime_s + BEAT_EVAL_TOLERANCE_S)
+        {
+            const double offset_s = detectionTimes_s[nextDetection] - beatTime_s;
+            ++score->hitCount;
+            score->offsetSum_s += offset_s;
+            if (fabs(offset_s) > fabs(score->worstOffset_s))
+            {
+                score->worstOffset_s = offset_s;
+            }
+            ++nextDetection;
+        }
+    }
+}
+
+static void PrintScore(const char *name, const clipScore_t *score)
+{
+    const double precision = (score->detectionCount > 0) ? (double)score->hitCount / score->detectionCount : 1.0;
+    const double recall = (score->beatCount > 0) ? (double)score->hitCount / score->beatCount : 1.0;
+    const double meanOffset_ms = (score->hitCount > 0) ? 1000 * score->offsetSum_s / score->hitCount : 0;
+    printf("%-24s %6u %6u %6u %6.3f %6.3f %6.3f %9.1f %9.1f\n", name, score->beatCount, score->hitCount,
+           score->detectionCount - score->hitCount, precision, recall, FMeasure(score), meanOffset_ms,
+           1000 * score->worstOffset_s);
+}
+
+// A clip with no beats and no detections is a perfect score
+static double FMeasure(const clipScore_t *score)
+{
+    const uint32_t missCount = score->beatCount - score->hitCount;
+    const uint32_t falseCount = score->detectionCount - score->hitCount;
+    if (score->hitCount == 0)
+    {
+        return (missCount == 0 && falseCount == 0) ? 1.0 : 0.0;
+    }
+    return 2.0 * score->hitCount / (2.0 * score->hitCount + missCount + falseCount);
+}
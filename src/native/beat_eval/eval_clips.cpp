@@ -0,0 +1,187 @@
+#include "eval_clips.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include "beat_detection.h"
+
+#define CLIP_LEAD_IN_S 0.5
+#define KICK_DURATION_S 0.25
+#define CLICK_DURATION_S 0.01
+#define HAT_DURATION_S 0.06
+
+enum class BeatSound
+{
+    none,
+    kick,
+    click,
+};
+
+typedef struct synthSpec_t
+{
+    const char *name;
+    float bpm;
+    float duration_s;
+    BeatSound beatSound;
+    float beatAmplitude;
+    // Beats land up to this early or late, and vary in level by up to this fraction
+    float timingJitter_ms;
+    float amplitudeJitter;
+    bool hasOffbeatHats;
+    bool hasBassline;
+    float noiseAmplitude;
+    // Steady tone, like a held synth note that should never count as a beat
+    float toneAmplitude;
+    // No beats between these times, 0 for none
+    float breakStart_s;
+    float breakEnd_s;
+} synthSpec_s;
+
+static const synthSpec_t syntheticSpecs[] = {
+    {"click_120", 120, 20, BeatSound::click, 0.8f, 0, 0, false, false, 0.02f, 0, 0, 0},
+    {"kick_124", 124, 30, BeatSound::kick, 0.7f, 0, 0, false, false, 0.05f, 0.05f, 0, 0},
+    {"kick_87_noisy", 87, 30, BeatSound::kick, 0.6f, 0, 0, false, false, 0.15f, 0, 0, 0},
+    {"kick_160", 160, 30, BeatSound::kick, 0.7f, 0, 0, false, false, 0.05f, 0, 0, 0},
+    {"kick_hats_bass_124", 124, 30, BeatSound::kick, 0.6f, 0, 0, true, true, 0.08f, 0, 0, 0},
+    {"kick_loose_128_break", 128, 40, BeatSound::kick, 0.5f, 10, 0.5f, true, false, 0.05f, 0, 15, 22},
+    {"noise_only", 0, 20, BeatSound::none, 0, 0, 0, false, true, 0.1f, 0.05f, 0, 0},
+};
+
+// xorshift32, fixed seed per clip so the corpus never changes
+static uint32_t randomState;
+
+static float RandomUniform()
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return (randomState / 4294967296.0f) * 2.0f - 1.0f;
+}
+
+static void SynthesizeClip(const synthSpec_t *spec, evalClip_t *clip);
+static void AddKick(std::vector<float> *audio, double time_s, float amplitude);
+static void AddClick(std::vector<float> *audio, double time_s, float amplitude);
+static void AddHat(std::vector<float> *audio, double time_s, float amplitude);
+
+void BuildSyntheticClips(std::vector<evalClip_t> *clips)
+{
+    for (const synthSpec_t &spec : syntheticSpecs)
+    {
+        evalClip_t clip;
+        SynthesizeClip(&spec, &clip);
+        clips->push_back(clip);
+    }
+}
+
+bool LoadAnnotatedClip(const char *audioPath, evalClip_t *clip)
+{
+    const std::string annotationPath = std::string(audioPath) + ".beats";
+    FILE *file = fopen(annotationPath.c_str(), "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Could not open %s\n", annotationPath.c_str());
+        return false;
+    }
+    clip->name = audioPath;
+    clip->audioPath = audioPath;
+    double beatTime_s;
+    while (fscanf(file, "%lf", &beatTime_s) == 1)
+    {
+        clip->beatTimes_s.push_back(beatTime_s);
+    }
+    fclose(file);
+    return true;
+}
+
+static void SynthesizeClip(const synthSpec_t *spec, evalClip_t *clip)
+{
+    const size_t sampleCount = (size_t)(spec->duration_s * SAMPLING_FREQUENCY_HZ);
+    std::vector<float> audio(sampleCount, 0.0f);
+    randomState = 0x9E3779B9u;
+    clip->name = spec->name;
+
+    if (spec->beatSound != BeatSound::none)
+    {
+        const double beatPeriod_s = 60.0 / spec->bpm;
+        for (double gridTime_s = CLIP_LEAD_IN_S; gridTime_s < spec->duration_s - KICK_DURATION_S; gridTime_s += beatPeriod_s)
+        {
+            const bool isInBreak = (gridTime_s >= spec->breakStart_s) && (gridTime_s < spec->breakEnd_s);
+            if (!isInBreak)
+            {
+                const double beatTime_s = gridTime_s + RandomUniform() * spec->timingJitter_ms / 1000.0;
+                const float amplitude = spec->beatAmplitude * (1.0f - spec->amplitudeJitter * 0.5f * (RandomUniform() + 1.0f));
+                if (spec->beatSound == BeatSound::kick)
+                {
+                    AddKick(&audio, beatTime_s, amplitude);
+                }
+                else
+                {
+                    AddClick(&audio, beatTime_s, amplitude);
+                }
+                clip->beatTimes_s.push_back(beatTime_s);
+            }
+            if (spec->hasOffbeatHats)
+            {
+                AddHat(&audio, gridTime_s + beatPeriod_s / 2, 0.35f);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < sampleCount; ++i)
+    {
+        const double time_s = (double)i / SAMPLING_FREQUENCY_HZ;
+        float sample = audio[i] + spec->noiseAmplitude * RandomUniform();
+        sample += spec->toneAmplitude * sinf((float)(2 * M_PI * fmod(880.0 * time_s, 1.0)));
+        if (spec->hasBassline)
+        {
+            // Held notes alternating every two seconds, bass energy with no onsets of its own
+            const double frequency_hz = ((int)(time_s / 2) % 2 == 0) ? 55.0 : 73.0;
+            sample += 0.15f * sinf((float)(2 * M_PI * fmod(frequency_hz * time_s, 1.0)));
+        }
+        audio[i] = sample;
+    }
+
+    clip->samples.resize(sampleCount);
+    for (size_t i = 0; i < sampleCount; ++i)
+    {
+        const float sample = fmaxf(-1.0f, fminf(audio[i], 1.0f));
+        clip->samples[i] = (int32_t)(sample * 2147483520.0f);
+    }
+}
+
+// Sine sweeping down from 140 Hz to 50 Hz with an exponential decay
+static void AddKick(std::vector<float> *audio, double time_s, float amplitude)
+{
+    const size_t start = (size_t)(time_s * SAMPLING_FREQUENCY_HZ);
+    for (size_t i = 0; i < (size_t)(KICK_DURATION_S * SAMPLING_FREQUENCY_HZ) && start + i < audio->size(); ++i)
+    {
+        const double t = (double)i / SAMPLING_FREQUENCY_HZ;
+        const double phase = 50 * t + 90 * (1 - exp(-t * 30)) / 30;
+        (*audio)[start + i] += amplitude * (float)(exp(-t * 12) * sin(2 * M_PI * phase));
+    }
+}
+
+// Short decaying burst of white noise, broadband with little bass
+static void AddClick(std::vector<float> *audio, double time_s, float amplitude)
+{
+    const size_t start = (size_t)(time_s * SAMPLING_FREQUENCY_HZ);
+    for (size_t i = 0; i < (size_t)(CLICK_DURATION_S * SAMPLING_FREQUENCY_HZ) && start + i < audio->size(); ++i)
+    {
+        const double t = (double)i / SAMPLING_FREQUENCY_HZ;
+        (*audio)[start + i] += amplitude * (float)exp(-t * 500) * RandomUniform();
+    }
+}
+
+// Differentiated white noise, high passed so nearly all its energy is well above the bass
+static void AddHat(std::vector<float> *audio, double time_s, float amplitude)
+{
+    const size_t start = (size_t)(time_s * SAMPLING_FREQUENCY_HZ);
+    float previous = 0;
+    for (size_t i = 0; i < (size_t)(HAT_DURATION_S * SAMPLING_FREQUENCY_HZ) && start + i < audio->size(); ++i)
+    {
+        const double t = (double)i / SAMPLING_FREQUENCY_HZ;
+        const float noise = RandomUniform();
+        (*audio)[start + i] += amplitude * (float)exp(-t * 60) * (noise - previous);
+        previous = noise;
+    }
+}
@@ -0,0 +1,25 @@
+#ifndef EVAL_CLIPS_H
+#define EVAL_CLIPS_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Annotated audio for env:beat_eval. The synthetic corpus is generated in memory with a fixed
+// seed, so every run scores exactly the same audio.
+
+typedef struct evalClip_t
+{
+    std::string name;
+    // Left justified 32 bit samples at SAMPLING_FREQUENCY_HZ, empty for clips played from a file
+    std::vector<int32_t> samples;
+    std::string audioPath;
+    std::vector<double> beatTimes_s;
+} evalClip_s;
+
+void BuildSyntheticClips(std::vector<evalClip_t> *clips);
+
+// Load the beat annotations for an audio file from <audioPath>.beats, one time in seconds per line
+bool LoadAnnotatedClip(const char *audioPath, evalClip_t *clip);
+
+#endif // EVAL_CLIPS_H
@@ -0,0 +1,183 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#include "compositor.h"
+#include "effects.h"
+#include "native_hal.h"
+#include "output_stage.h"
+#include "palette.h"
+
+// Host entry point for env:effect_bench. First checks that switching between two ambient
+// effects crossfades rather than cutting, failing the run if not. Then renders every effect
+// on its own for a fixed run of frames, with a beat every BENCH_BEAT_PERIOD_MS, and reports
+// how long Render() takes. Then times each blend mode, whole composited frames with every
+// layer crossfading and the output stage.
+// Usage: program [frames]
+// The times are host nanoseconds, only compare them with each other and with earlier runs
+// on the same machine.
+
+#define BENCH_DEFAULT_FRAMES 20000
+#define BENCH_FRAME_PERIOD_MS 15
+// About 120 bpm, snapped to the frame grid
+#define BENCH_BEAT_PERIOD_MS 495
+
+typedef struct benchTimes_t
+{
+    std::vector<uint32_t> times_ns;
+    uint64_t sum_ns;
+} benchTimes_s;
+
+static bool CheckAmbientCrossfade();
+static uint32_t FrameBrightness();
+static void BenchEffect(LedEffect *effect, uint32_t frameCount);
+static void BenchBlend(const char *name, BlendMode mode, uint32_t frameCount);
+static void BenchCompositor(uint32_t frameCount);
+static void BenchOutput(uint32_t frameCount);
+static void PrintTimes(const char *name, benchTimes_t *times);
+
+int main(int argc, char *argv[])
+{
+    const uint32_t frameCount = (argc > 1) ? (uint32_t)atoi(argv[1]) : BENCH_DEFAULT_FRAMES;
+    if (frameCount == 0)
+    {
+        fprintf(stderr, "Usage: %s [frames]\n", argv[0]);
+        return 1;
+    }
+    PaletteInit(Colour::cb);
+    if (!CheckAmbientCrossfade())
+    {
+        return 1;
+    }
+
+    printf("%u frames of %d ms, %d LEDs\n", frameCount, BENCH_FRAME_PERIOD_MS, NUM_LEDS);
+    printf("%-20s %9s %9s %9s\n", "effect", "mean ns", "p99 ns", "max ns");
+    for (uint32_t i = 0; i < LedEffectCount(); ++i)
+    {
+        BenchEffect(GetLedEffect(i), frameCount);
+    }
+    BenchBlend("blend add", BlendMode::add, frameCount);
+    BenchBlend("blend max", BlendMode::max, frameCount);
+    BenchBlend("blend alpha", BlendMode::alpha, frameCount);
+    BenchCompositor(frameCount);
+    BenchOutput(frameCount);
+    return 0;
+}
+
+// An ambient effect replaced by another must fade out over LAYER_CROSSFADE_MS, not cut to
+// whatever the new one draws first. no_effect draws nothing, so all that shows is the fade.
+static bool CheckAmbientCrossfade()
+{
+    const effectEvents_t noBeat = {false};
+    int64_t now_ms = 0;
+    for (uint32_t frame = 0; frame < 100; ++frame, now_ms += BENCH_FRAME_PERIOD_MS)
+    {
+        RenderLayers(Effect::wave_clockwise, now_ms, BENCH_FRAME_PERIOD_MS, noBeat);
+    }
+    const uint32_t before = FrameBrightness();
+    uint32_t last = before;
+    bool isFading = (before > 0);
+    uint32_t fadeFrames = 0;
+    for (; fadeFrames * BENCH_FRAME_PERIOD_MS < LAYER_CROSSFADE_MS; ++fadeFrames, now_ms += BENCH_FRAME_PERIOD_MS)
+    {
+        RenderLayers(Effect::no_effect, now_ms, BENCH_FRAME_PERIOD_MS, noBeat);
+        const uint32_t brightness = FrameBrightness();
+        // Wave's last frame is frozen, so it may only get darker, and the first frame barely
+        isFading = isFading && (brightness <= last) && (fadeFrames > 0 || brightness * 10 >= before * 9);
+        last = brightness;
+    }
+    RenderLayers(Effect::no_effect, now_ms, BENCH_FRAME_PERIOD_MS, noBeat);
+    isFading = isFading && (FrameBrightness() == 0);
+    printf("ambient crossfade %s, %u brightness before the switch\n", isFading ? "fades" : "FAILED", before);
+    return isFading;
+}
+
+static uint32_t FrameBrightness()
+{
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < NUM_LEDS; ++i)
+    {
+        sum += leds[i].r + leds[i].g + leds[i].b;
+    }
+    return sum;
+}
+
+static void BenchEffect(LedEffect *effect, uint32_t frameCount)
+{
+    static ledCanvas_t canvas;
+    benchTimes_t times = {std::vector<uint32_t>(frameCount), 0};
+    ClearCanvas(&canvas);
+    effect->Reset();
+    for (uint32_t frame = 0; frame < frameCount; ++frame)
+    {
+        const int64_t now_ms = (int64_t)frame * BENCH_FRAME_PERIOD_MS;
+        const effectEvents_t events = {now_ms % BENCH_BEAT_PERIOD_MS == 0};
+        const uint32_t start = NativeCycleCount();
+        effect->Render(&canvas, now_ms, BENCH_FRAME_PERIOD_MS, events);
+        times.times_ns[frame] = NativeCycleCount() - start;
+        times.sum_ns += times.times_ns[frame];
+    }
+    PrintTimes(effect->name, &times);
+}
+
+// One layer blended over a full frame, the opacity changing every call as in a crossfade
+static void BenchBlend(const char *name, BlendMode mode, uint32_t frameCount)
+{
+    static CRGB layer[NUM_LEDS];
+    benchTimes_t times = {std::vector<uint32_t>(frameCount), 0};
+    for (uint32_t i = 0; i < NUM_LEDS; ++i)
+    {
+        layer[i] = CRGB((uint8_t)(i * 7), (uint8_t)(i * 13), (uint8_t)(i * 29));
+    }
+    for (uint32_t frame = 0; frame < frameCount; ++frame)
+    {
+        const uint32_t start = NativeCycleCount();
+        BlendLeds(leds, layer, NUM_LEDS, mode, (uint8_t)(frame | 1));
+        times.times_ns[frame] = NativeCycleCount() - start;
+        times.sum_ns += times.times_ns[frame];
+    }
+    PrintTimes(name, &times);
+}
+
+// Whole frames, switching layer every few frames so all three are always playing or fading
+static void BenchCompositor(uint32_t frameCount)
+{
+    static const Effect cycle[] = {Effect::twinkle, Effect::wave_up_down, Effect::strobe, Effect::random_cross};
+    benchTimes_t times = {std::vector<uint32_t>(frameCount), 0};
+    for (uint32_t frame = 0; frame < frameCount; ++frame)
+    {
+        const int64_t now_ms = (int64_t)frame * BENCH_FRAME_PERIOD_MS;
+        const effectEvents_t events = {now_ms % BENCH_BEAT_PERIOD_MS == 0};
+        const Effect selected = cycle[(frame / 8) % (sizeof(cycle) / sizeof(cycle[0]))];
+        const uint32_t start = NativeCycleCount();
+        RenderLayers(selected, now_ms, BENCH_FRAME_PERIOD_MS, events);
+        times.times_ns[frame] = NativeCycleCount() - start;
+        times.sum_ns += times.times_ns[frame];
+    }
+    PrintTimes("composited frame", &times);
+}
+
+// Gamma, brightness and dithering of a whole frame, at a dim setting
+static void BenchOutput(uint32_t frameCount)
+{
+    static CRGB output[NUM_LEDS];
+    benchTimes_t times = {std::vector<uint32_t>(frameCount), 0};
+    SetOutputBrightness(40);
+    for (uint32_t frame = 0; frame < frameCount; ++frame)
+    {
+        const uint32_t start = NativeCycleCount();
+        RenderOutput(output, leds, NUM_LEDS);
+        times.times_ns[frame] = NativeCycleCount() - start;
+        times.sum_ns += times.times_ns[frame];
+    }
+    PrintTimes("output stage", &times);
+}
+
+static void PrintTimes(const char *name, benchTimes_t *times)
+{
+    const uint32_t count = times->times_ns.size();
+    std::sort(times->times_ns.begin(), times->times_ns.end());
+    printf("%-20s %9.0f %9u %9u\n", name, (double)times->sum_ns / count,
+           times->times_ns[(uint32_t)(count * 0.99)], times->times_ns[count - 1]);
+}
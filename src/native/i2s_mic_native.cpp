@@ -0,0 +1,33 @@
+#include "i2s_mic.h"
+
+#include "native_hal.h"
+
+// Host replacement for i2s_mic.cpp, samples come from the audio file given to NativeHalInit()
+
+static uint32_t hopCount = 0;
+
+void I2sInit()
+{
+}
+
+// Return true if read FFT_HOP_LENGTH samples
+// @param rawMicSamples[out]    Output buffer to store samples from mic in
+// @param captureTime_us[out]   When the last of them was captured, from the running sample count
+bool ReadMicData(int32_t rawMicSamples[FFT_HOP_LENGTH], int64_t *captureTime_us)
+{
+    const size_t samplesRead = NativeAudioRead(rawMicSamples, FFT_HOP_LENGTH);
+    // The simulated clock is the sample count, so every hop is read the moment it is captured
+    *captureTime_us = NativeClockMicros();
+    ++hopCount;
+    return (samplesRead == FFT_HOP_LENGTH);
+}
+
+// Nothing is ever dropped or late reading from a file
+void GetMicStats(micStats_t *stats)
+{
+    static uint32_t lastHopCount = 0;
+    *stats = {};
+    stats->hopCount = hopCount - lastHopCount;
+    stats->sampleCount = NativeAudioSamplesRead();
+    lastHopCount = hopCount;
+}
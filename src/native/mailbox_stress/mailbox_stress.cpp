@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <thread>
+
+#include "triple_buffer.h"
+
+// Host entry point for env:mailbox_stress. One thread writes sequence stamped items into a
+// TripleBuffer as fast as it can while another polls it, checking every item read is whole
+// and never older than the one before. Exits non-zero on a torn or backwards read.
+// Usage: program [writes]
+// Add -fsanitize=thread to the env's build_flags to have ThreadSanitizer watch the handoff.
+
+#define STRESS_DEFAULT_WRITES 20000000
+// The writer yields every this many writes, so the reader also sees the slots change under it
+#define STRESS_YIELD_PERIOD 64
+// Item as big as the radio command it stands in for, many times over, so a torn copy shows
+#define STRESS_ITEM_WORDS 15
+#define STRESS_STAMP(sequence, word) ((sequence) * 2654435761u + (word))
+
+typedef struct stressItem_t
+{
+    uint32_t sequence;
+    uint32_t words[STRESS_ITEM_WORDS];
+} stressItem_s;
+
+static TripleBuffer<stressItem_t> mailbox;
+
+static void WriteItems(uint32_t writeCount)
+{
+    stressItem_t item;
+    for (uint32_t sequence = 1; sequence <= writeCount; ++sequence)
+    {
+        item.sequence = sequence;
+        for (uint32_t word = 0; word < STRESS_ITEM_WORDS; ++word)
+        {
+            item.words[word] = STRESS_STAMP(sequence, word);
+        }
+        mailbox.Write(item);
+        if (sequence % STRESS_YIELD_PERIOD == 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const uint32_t writeCount = (argc > 1) ? (uint32_t)atoi(argv[1]) : STRESS_DEFAULT_WRITES;
+    if (writeCount == 0)
+    {
+        fprintf(stderr, "Usage: %s [writes]\n", argv[0]);
+        return 1;
+    }
+
+    std::thread writer(WriteItems, writeCount);
+    stressItem_t item = {};
+    uint32_t lastSequence = 0;
+    uint64_t readCount = 0;
+    uint64_t tornCount = 0;
+    uint64_t backwardsCount = 0;
+    // The writer's last item is always left fresh for the reader, so this loop ends
+    while (lastSequence != writeCount)
+    {
+        if (!mailbox.Read(&item))
+        {
+            // Hands the core back to the writer where both threads share one
+            std::this_thread::yield();
+            continue;
+        }
+        ++readCount;
+        for (uint32_t word = 0; word < STRESS_ITEM_WORDS; ++word)
+        {
+            if (item.words[word] != STRESS_STAMP(item.sequence, word))
+            {
+                ++tornCount;
+                break;
+            }
+        }
+        if (item.sequence <= lastSequence)
+        {
+            ++backwardsCount;
+        }
+        lastSequence = item.sequence;
+    }
+    writer.join();
+
+    printf("%u writes, %llu reads, %llu torn, %llu backwards\n", writeCount,
+           (unsigned long long)readCount, (unsigned long long)tornCount, (unsigned long long)backwardsCount);
+    return (tornCount == 0 && backwardsCount == 0) ? 0 : 1;
+}
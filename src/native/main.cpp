@@ -0,0 +1,79 @@
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#include "effects.h"
+#include "led_canvas.h"
+#include "native_hal.h"
+#include "profiling.h"
+
+// Host entry point for env:native. Runs the hat's setup() and loop() over an audio
+// file as fast as the CPU allows, writing every shown frame to an optional frame file
+// and, when built with TRACE_ENABLED, the trace of the whole run to an optional trace file.
+// Usage: program <audio.wav|audio.raw> [frames.bin|-] [trace.bin]
+
+void setup();
+void loop();
+
+static FILE *traceFile = NULL;
+
+static void FileTraceWriter(const uint8_t *bytes, size_t length);
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <audio.wav|audio.raw> [frames.bin|-] [trace.bin]\n", argv[0]);
+        return 1;
+    }
+    const char *framesPath = (argc > 2 && strcmp(argv[2], "-") != 0) ? argv[2] : NULL;
+    if (!NativeHalInit(argv[1], framesPath))
+    {
+        NativeHalShutdown();
+        return 1;
+    }
+
+    if (argc > 3)
+    {
+        traceFile = fopen(argv[3], "wb");
+        if (traceFile == NULL)
+        {
+            fprintf(stderr, "Could not open %s for writing\n", argv[3]);
+            NativeHalShutdown();
+            return 1;
+        }
+    }
+
+    setup();
+    const auto start = std::chrono::steady_clock::now();
+    uint32_t loopCount = 0;
+    while (!NativeAudioIsExhausted())
+    {
+        loop();
+        ++loopCount;
+        // Drain the ring well before it wraps so the file holds every record
+        const bool isTraceHalfFull = (traceRings[0].writeIndex.load(std::memory_order_relaxed) - traceRings[0].dumpedIndex) >= TRACE_RING_LENGTH / 2;
+        if (traceFile != NULL && isTraceHalfFull)
+        {
+            TraceDump(FileTraceWriter);
+        }
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    const double audioSeconds = NativeClockMicros() / 1e6;
+    printf("%.2f s of audio in %.3f s (%.1fx real time), %u loops, %u frames\n",
+           audioSeconds, elapsed.count(), audioSeconds / elapsed.count(), loopCount, NativeLedFramesWritten());
+    printf("%u unchanged frames not sent, %u black LEDs not faded\n", UnchangedFrameCount(), FadeSkippedLedCount());
+    if (traceFile != NULL)
+    {
+        TraceDump(FileTraceWriter);
+        fclose(traceFile);
+    }
+    NativeHalShutdown();
+    return 0;
+}
+
+static void FileTraceWriter(const uint8_t *bytes, size_t length)
+{
+    fwrite(bytes, 1, length, traceFile);
+}
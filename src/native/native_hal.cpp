@@ -0,0 +1,288 @@
+#include "native_hal.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#include "beat_detection.h"
+
+#define WAV_FORMAT_PCM 0x0001
+#define WAV_FORMAT_IEEE_FLOAT 0x0003
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+#define AUDIO_READ_CHUNK_BYTES 4096
+
+typedef struct audioSource_t
+{
+    FILE *file;
+    // Set instead of file when the samples are already in memory
+    const int32_t *samples;
+    uint64_t sampleCount;
+    uint16_t format;
+    uint16_t channels;
+    uint16_t bytesPerSample;
+    uint64_t dataBytesRemaining;
+    uint64_t samplesRead;
+    bool isExhausted;
+} audioSource_s;
+
+static audioSource_t audioSource = {};
+static FILE *framesFile = NULL;
+static uint32_t framesWritten = 0;
+
+static bool OpenWav(const char *path);
+static bool OpenRaw(const char *path);
+static int32_t DecodeSample(const uint8_t *bytes);
+static uint32_t ReadLe(const uint8_t *bytes, int count);
+
+bool NativeHalInit(const char *audioPath, const char *framesPath)
+{
+    audioSource = {};
+    framesWritten = 0;
+    const char *extension = strrchr(audioPath, '.');
+    const bool isWav = (extension != NULL) && (strcmp(extension, ".wav") == 0 || strcmp(extension, ".WAV") == 0);
+    if (!(isWav ? OpenWav(audioPath) : OpenRaw(audioPath)))
+    {
+        // OpenWav() leaves the file open when the header is bad
+        NativeHalShutdown();
+        return false;
+    }
+    if (framesPath != NULL)
+    {
+        framesFile = fopen(framesPath, "wb");
+        if (framesFile == NULL)
+        {
+            fprintf(stderr, "Could not open %s for writing\n", framesPath);
+            NativeHalShutdown();
+            return false;
+        }
+    }
+    return true;
+}
+
+bool NativeHalInitSamples(const int32_t *samples, size_t count)
+{
+    audioSource = {};
+    audioSource.samples = samples;
+    audioSource.sampleCount = count;
+    framesWritten = 0;
+    return true;
+}
+
+void NativeHalShutdown()
+{
+    if (audioSource.file != NULL)
+    {
+        fclose(audioSource.file);
+        audioSource.file = NULL;
+    }
+    if (framesFile != NULL)
+    {
+        fclose(framesFile);
+        framesFile = NULL;
+    }
+}
+
+int64_t NativeClockMicros()
+{
+    return (int64_t)(audioSource.samplesRead * 1000000u / SAMPLING_FREQUENCY_HZ);
+}
+
+uint32_t NativeCycleCount()
+{
+    const auto sinceEpoch = std::chrono::steady_clock::now().time_since_epoch();
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(sinceEpoch).count();
+}
+
+size_t NativeAudioRead(int32_t *samples, size_t count)
+{
+    if (audioSource.samples != NULL)
+    {
+        const uint64_t samplesLeft = audioSource.sampleCount - audioSource.samplesRead;
+        const size_t samplesCopied = (count < samplesLeft) ? count : (size_t)samplesLeft;
+        memcpy(samples, &audioSource.samples[audioSource.samplesRead], samplesCopied * sizeof(int32_t));
+        audioSource.isExhausted = (samplesCopied < count) || (samplesCopied == samplesLeft);
+        audioSource.samplesRead += samplesCopied;
+        return samplesCopied;
+    }
+    const size_t frameBytes = audioSource.bytesPerSample * audioSource.channels;
+    uint8_t chunk[AUDIO_READ_CHUNK_BYTES];
+    size_t samplesDecoded = 0;
+    while (samplesDecoded < count && !audioSource.isExhausted)
+    {
+        size_t framesWanted = count - samplesDecoded;
+        if (framesWanted > sizeof(chunk) / frameBytes)
+        {
+            framesWanted = sizeof(chunk) / frameBytes;
+        }
+        if (framesWanted * frameBytes > audioSource.dataBytesRemaining)
+        {
+            framesWanted = audioSource.dataBytesRemaining / frameBytes;
+        }
+        const size_t framesGot = (framesWanted == 0) ? 0 : fread(chunk, frameBytes, framesWanted, audioSource.file);
+        if (framesGot < framesWanted || framesGot == 0)
+        {
+            audioSource.isExhausted = true;
+        }
+        // The mic is mono, so only the first channel of the file is used
+        for (size_t frame = 0; frame < framesGot; ++frame)
+        {
+            samples[samplesDecoded++] = DecodeSample(&chunk[frame * frameBytes]);
+        }
+        audioSource.dataBytesRemaining -= framesGot * frameBytes;
+    }
+    audioSource.samplesRead += samplesDecoded;
+    return samplesDecoded;
+}
+
+bool NativeAudioIsExhausted()
+{
+    return audioSource.isExhausted;
+}
+
+uint64_t NativeAudioSamplesRead()
+{
+    return audioSource.samplesRead;
+}
+
+void NativeLedWriteFrame(const uint8_t *rgb, uint16_t numLeds, uint8_t brightness)
+{
+    ++framesWritten;
+    if (framesFile == NULL)
+    {
+        return;
+    }
+    const uint32_t timestamp_ms = (uint32_t)(NativeClockMicros() / 1000);
+    fwrite(&timestamp_ms, sizeof(timestamp_ms), 1, framesFile);
+    fwrite(&brightness, sizeof(brightness), 1, framesFile);
+    fwrite(&numLeds, sizeof(numLeds), 1, framesFile);
+    fwrite(rgb, 3, numLeds, framesFile);
+}
+
+uint32_t NativeLedFramesWritten()
+{
+    return framesWritten;
+}
+
+// ----- Audio file parsing -----
+
+static bool OpenWav(const char *path)
+{
+    audioSource.file = fopen(path, "rb");
+    if (audioSource.file == NULL)
+    {
+        fprintf(stderr, "Could not open %s\n", path);
+        return false;
+    }
+    uint8_t header[12];
+    if (fread(header, 1, sizeof(header), audioSource.file) != sizeof(header) ||
+        memcmp(header, "RIFF", 4) != 0 || memcmp(&header[8], "WAVE", 4) != 0)
+    {
+        fprintf(stderr, "%s is not a RIFF/WAVE file\n", path);
+        return false;
+    }
+
+    uint32_t sampleRate = 0;
+    bool isFormatFound = false;
+    uint8_t chunkHeader[8];
+    while (fread(chunkHeader, 1, sizeof(chunkHeader), audioSource.file) == sizeof(chunkHeader))
+    {
+        const uint32_t chunkSize = ReadLe(&chunkHeader[4], 4);
+        if (memcmp(chunkHeader, "fmt ", 4) == 0)
+        {
+            uint8_t fmt[40] = {0};
+            const size_t fmtBytes = chunkSize < sizeof(fmt) ? chunkSize : sizeof(fmt);
+            if (fread(fmt, 1, fmtBytes, audioSource.file) != fmtBytes)
+            {
+                break;
+            }
+            fseek(audioSource.file, (long)(chunkSize - fmtBytes + (chunkSize & 1)), SEEK_CUR);
+            audioSource.format = (uint16_t)ReadLe(&fmt[0], 2);
+            audioSource.channels = (uint16_t)ReadLe(&fmt[2], 2);
+            sampleRate = ReadLe(&fmt[4], 4);
+            audioSource.bytesPerSample = (uint16_t)(ReadLe(&fmt[14], 2) / 8);
+            if (audioSource.format == WAV_FORMAT_EXTENSIBLE && fmtBytes >= 26)
+            {
+                // First two bytes of the sub format GUID hold the actual format tag
+                audioSource.format = (uint16_t)ReadLe(&fmt[24], 2);
+            }
+            isFormatFound = true;
+        }
+        else if (memcmp(chunkHeader, "data", 4) == 0)
+        {
+            audioSource.dataBytesRemaining = chunkSize;
+            break;
+        }
+        else
+        {
+            fseek(audioSource.file, (long)(chunkSize + (chunkSize & 1)), SEEK_CUR);
+        }
+    }
+
+    if (!isFormatFound || audioSource.dataBytesRemaining == 0 || audioSource.channels == 0)
+    {
+        fprintf(stderr, "%s has no usable fmt/data chunks\n", path);
+        return false;
+    }
+    const bool isPcm = (audioSource.format == WAV_FORMAT_PCM) &&
+                       (audioSource.bytesPerSample >= 2 && audioSource.bytesPerSample <= 4);
+    const bool isFloat = (audioSource.format == WAV_FORMAT_IEEE_FLOAT) && (audioSource.bytesPerSample == 4);
+    if (!isPcm && !isFloat)
+    {
+        fprintf(stderr, "%s: only 16/24/32 bit PCM or 32 bit float WAV is supported\n", path);
+        return false;
+    }
+    if (sampleRate != SAMPLING_FREQUENCY_HZ)
+    {
+        fprintf(stderr, "%s: sample rate is %u Hz but the hat samples at %u Hz, resample it first\n",
+                path, (unsigned)sampleRate, (unsigned)SAMPLING_FREQUENCY_HZ);
+        return false;
+    }
+    return true;
+}
+
+// Headerless raw PCM is taken to be mono signed 16 bit little endian at SAMPLING_FREQUENCY_HZ
+static bool OpenRaw(const char *path)
+{
+    audioSource.file = fopen(path, "rb");
+    if (audioSource.file == NULL)
+    {
+        fprintf(stderr, "Could not open %s\n", path);
+        return false;
+    }
+    audioSource.format = WAV_FORMAT_PCM;
+    audioSource.channels = 1;
+    audioSource.bytesPerSample = 2;
+    audioSource.dataBytesRemaining = UINT64_MAX;
+    return true;
+}
+
+// Convert one sample to the left justified 32 bit layout of the I2S mic data
+static int32_t DecodeSample(const uint8_t *bytes)
+{
+    if (audioSource.format == WAV_FORMAT_IEEE_FLOAT)
+    {
+        float value;
+        memcpy(&value, bytes, sizeof(value));
+        if (value >= 1.0f)
+        {
+            return INT32_MAX;
+        }
+        if (value <= -1.0f)
+        {
+            return INT32_MIN;
+        }
+        return (int32_t)(value * 2147483648.0f);
+    }
+    const int shift = 8 * (4 - audioSource.bytesPerSample);
+    return (int32_t)(ReadLe(bytes, audioSource.bytesPerSample) << shift);
+}
+
+static uint32_t ReadLe(const uint8_t *bytes, int count)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        value |= (uint32_t)bytes[i] << (8 * i);
+    }
+    return value;
+}
@@ -0,0 +1,34 @@
+#ifndef NATIVE_HAL_H
+#define NATIVE_HAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Host stand-ins for the hat hardware, only built by env:native and env:beat_eval.
+//
+// Time is simulated: the clock only moves when audio is consumed, by exactly the
+// duration of the samples read. A run over the same file is therefore fully
+// deterministic and runs as fast as the host can process it.
+
+bool NativeHalInit(const char *audioPath, const char *framesPath);
+// Play samples from memory instead, already in the left justified 32 bit mic layout.
+// The clock restarts from zero, so several clips can run one after another.
+bool NativeHalInitSamples(const int32_t *samples, size_t count);
+void NativeHalShutdown();
+
+int64_t NativeClockMicros();
+// Real host time in nanoseconds, for measuring how long code takes
+uint32_t NativeCycleCount();
+
+// Read up to count samples as left justified 32 bit words, the same layout the
+// I2S peripheral produces for the 24 bit mic. Returns the number of samples read.
+size_t NativeAudioRead(int32_t *samples, size_t count);
+bool NativeAudioIsExhausted();
+uint64_t NativeAudioSamplesRead();
+
+// Frame file format, one record per show():
+// uint32_t timestamp_ms, uint8_t brightness, uint16_t numLeds, numLeds * {r, g, b}
+void NativeLedWriteFrame(const uint8_t *rgb, uint16_t numLeds, uint8_t brightness);
+uint32_t NativeLedFramesWritten();
+
+#endif // NATIVE_HAL_H
@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "interface.h"
+#include "radio_protocol.h"
+
+// Host entry point for env:radio_sim. Runs the controller and hat ends of the radio protocol
+// against each other over an in-process loopback that drops, delays and corrupts packets, on a
+// simulated 1 ms clock. The controller changes its state every few hundred ms like someone at
+// the keypad. The hat restarts halfway through each run, and the controller three quarters of
+// the way, picking the same session as before so its new sequence numbers look stale. For each
+// loss rate it reports how long the hat takes to show the controller's state and how much went
+// over the air.
+// Usage: program [seconds]
+
+#define SIM_DEFAULT_SECONDS 600
+#define SIM_LATENCY_MS 2
+#define SIM_JITTER_MS 3
+#define SIM_CORRUPT_PROBABILITY 0.01f
+#define SIM_MIN_CHANGE_PERIOD_MS 100
+#define SIM_MAX_CHANGE_PERIOD_MS 800
+#define SIM_SEED 1234
+#define SIM_SESSION 0x5A
+
+typedef struct simPacket_t
+{
+    uint32_t deliverAt_ms;
+    bool isLost;
+    std::vector<uint8_t> bytes;
+} simPacket_s;
+
+// One direction of the link. Sent packets come out of Deliver() after the latency, unless lost.
+class LossyLoopback : public RadioTransport
+{
+public:
+    LossyLoopback(std::mt19937 *rng, float lossProbability) : rng(rng), lossProbability(lossProbability) {}
+
+    uint32_t now_ms = 0;
+    uint32_t packetCount = 0;
+    uint32_t byteCount = 0;
+
+    bool Send(const uint8_t *packet, uint8_t length) override
+    {
+        std::uniform_real_distribution<float> chance(0.0f, 1.0f);
+        std::uniform_int_distribution<uint32_t> jitter(0, SIM_JITTER_MS);
+        simPacket_t sent = {now_ms + SIM_LATENCY_MS + jitter(*rng), chance(*rng) < lossProbability, std::vector<uint8_t>(packet, packet + length)};
+        if (chance(*rng) < SIM_CORRUPT_PROBABILITY)
+        {
+            sent.bytes[(*rng)() % length] ^= (uint8_t)(1 << ((*rng)() % 8));
+        }
+        inFlight.push_back(sent);
+        ++packetCount;
+        byteCount += length;
+        return true;
+    }
+
+    // Hands every packet due by now_ms to onPacket, and its link layer status to onStatus
+    template <typename PacketFunction, typename StatusFunction>
+    void Deliver(PacketFunction onPacket, StatusFunction onStatus)
+    {
+        for (auto packet = inFlight.begin(); packet != inFlight.end();)
+        {
+            if (packet->deliverAt_ms > now_ms)
+            {
+                ++packet;
+                continue;
+            }
+            if (!packet->isLost)
+            {
+                onPacket(packet->bytes.data(), (int)packet->bytes.size());
+            }
+            onStatus(!packet->isLost);
+            packet = inFlight.erase(packet);
+        }
+    }
+
+private:
+    std::mt19937 *rng;
+    float lossProbability;
+    std::deque<simPacket_t> inFlight;
+};
+
+static void ChangeState(std::mt19937 *rng, radioData_t *state);
+static void RunSimulation(float lossProbability, uint32_t duration_ms);
+
+int main(int argc, char *argv[])
+{
+    const uint32_t seconds = (argc > 1) ? (uint32_t)atoi(argv[1]) : SIM_DEFAULT_SECONDS;
+    if (seconds == 0)
+    {
+        fprintf(stderr, "Usage: %s [seconds]\n", argv[0]);
+        return 1;
+    }
+    printf("%u s per run, %d-%d ms latency, %.0f%% corrupted, hat restarts at 1/2, controller at 3/4\n",
+           seconds, SIM_LATENCY_MS, SIM_LATENCY_MS + SIM_JITTER_MS, SIM_CORRUPT_PROBABILITY * 100.0f);
+    printf("%5s %7s %8s %8s %8s %7s %9s %8s %7s %7s %5s\n",
+           "loss", "changes", "mean ms", "p99 ms", "max ms", "missed", "bytes/chg", "retrans", "gaveup", "resync", "skip");
+    const float lossProbabilities[] = {0.0f, 0.1f, 0.2f, 0.3f, 0.5f};
+    for (float lossProbability : lossProbabilities)
+    {
+        RunSimulation(lossProbability, seconds * 1000);
+    }
+    return 0;
+}
+
+static void ChangeState(std::mt19937 *rng, radioData_t *state)
+{
+    switch ((*rng)() % 4)
+    {
+    case 0:
+        state->isEffectCommand = false;
+        state->colour = (int8_t)((*rng)() % (MAX_COLOUR_KEYPAD_INDEX + 1));
+        break;
+    case 1:
+        state->isEffectCommand = true;
+        state->effect = (int8_t)(MAX_COLOUR_KEYPAD_INDEX + 1 + (*rng)() % (MAX_EFFECT_KEYPAD_INDEX - MAX_COLOUR_KEYPAD_INDEX));
+        break;
+    case 2:
+        state->brightness = (uint8_t)((*rng)() % 256);
+        break;
+    default:
+        state->ambientOverride = !state->ambientOverride;
+        break;
+    }
+}
+
+static void RunSimulation(float lossProbability, uint32_t duration_ms)
+{
+    std::mt19937 rng(SIM_SEED);
+    LossyLoopback toHat(&rng, lossProbability);
+    LossyLoopback toController(&rng, lossProbability);
+    RadioSender *sender = new RadioSender(&toHat, SIM_SESSION);
+    RadioReceiver *receiver = new RadioReceiver(&toController, radioData);
+    radioReceiverStats_t restartedStats = {};
+    radioSenderStats_t restartedSenderStats = {};
+
+    radioData_t controllerState = radioData;
+    radioData_t hatState = radioData;
+    std::uniform_int_distribution<uint32_t> changePeriod(SIM_MIN_CHANGE_PERIOD_MS, SIM_MAX_CHANGE_PERIOD_MS);
+    uint32_t nextChange_ms = changePeriod(rng);
+    // Time from each change until the hat shows it, changes overtaken by the next are missed
+    std::vector<uint32_t> latencies_ms;
+    uint32_t changeCount = 0;
+    uint32_t missedCount = 0;
+    bool isPending = false;
+    uint32_t changedAt_ms = 0;
+
+    for (uint32_t now_ms = 0; now_ms < duration_ms; ++now_ms)
+    {
+        toHat.now_ms = now_ms;
+        toController.now_ms = now_ms;
+        if (now_ms == duration_ms / 2)
+        {
+            restartedStats = receiver->Stats();
+            delete receiver;
+            receiver = new RadioReceiver(&toController, radioData);
+            hatState = radioData;
+        }
+        if (now_ms == duration_ms * 3 / 4)
+        {
+            // Back to its defaults, which the hat is not showing any more
+            restartedSenderStats = sender->Stats();
+            delete sender;
+            sender = new RadioSender(&toHat, SIM_SESSION);
+            controllerState = radioData;
+            if (isPending)
+            {
+                ++missedCount;
+            }
+            ++changeCount;
+            isPending = true;
+            changedAt_ms = now_ms;
+        }
+        if (now_ms == nextChange_ms)
+        {
+            if (isPending)
+            {
+                ++missedCount;
+            }
+            ChangeState(&rng, &controllerState);
+            ++changeCount;
+            isPending = true;
+            changedAt_ms = now_ms;
+            nextChange_ms = now_ms + changePeriod(rng);
+        }
+        toHat.Deliver([&](const uint8_t *packet, int length) { receiver->OnReceive(packet, length, &hatState); },
+                      [&](bool isDelivered) { sender->OnSendStatus(isDelivered); });
+        toController.Deliver([&](const uint8_t *packet, int length) { sender->OnReceive(packet, length); },
+                             [](bool) {});
+        sender->Update(controllerState, now_ms);
+        if (isPending && hatState == controllerState)
+        {
+            latencies_ms.push_back(now_ms - changedAt_ms);
+            isPending = false;
+        }
+    }
+
+    radioSenderStats_t senderStats = sender->Stats();
+    senderStats.retransmitCount += restartedSenderStats.retransmitCount;
+    senderStats.givenUpCount += restartedSenderStats.givenUpCount;
+    senderStats.sequenceSkipCount += restartedSenderStats.sequenceSkipCount;
+    delete sender;
+    const uint32_t resyncCount = restartedStats.resyncCount + receiver->Stats().resyncCount;
+    delete receiver;
+
+    std::sort(latencies_ms.begin(), latencies_ms.end());
+    uint64_t sum_ms = 0;
+    for (uint32_t latency_ms : latencies_ms)
+    {
+        sum_ms += latency_ms;
+    }
+    const size_t count = latencies_ms.size();
+    printf("%4.0f%% %7u %8.1f %8u %8u %7u %9.1f %8u %7u %7u %5u\n",
+           lossProbability * 100.0f,
+           changeCount,
+           count ? (double)sum_ms / count : 0.0,
+           count ? latencies_ms[std::min(count - 1, count * 99 / 100)] : 0,
+           count ? latencies_ms.back() : 0,
+           missedCount + (isPending ? 1 : 0),
+           changeCount ? (double)(toHat.byteCount + toController.byteCount) / changeCount : 0.0,
+           senderStats.retransmitCount,
+           senderStats.givenUpCount,
+           resyncCount,
+           senderStats.sequenceSkipCount);
+}
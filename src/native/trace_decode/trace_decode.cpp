@@ -0,0 +1,278 @@
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "trace_format.h"
+
+// Host decoder for the trace dumps described in trace_format.h. Finds every dump in a capture,
+// such as a raw serial log with other output around the dumps or a trace file from env:native,
+// then prints a latency histogram per stage and optionally writes Chrome trace JSON, which
+// chrome://tracing and ui.perfetto.dev open.
+// Usage: program <capture.bin> [trace.json]
+
+// Histogram buckets double in width from 1 us, the last one takes everything longer
+#define HISTOGRAM_BUCKET_COUNT 18
+#define HISTOGRAM_BAR_WIDTH 40
+
+typedef struct traceEvent_t
+{
+    double time_us;
+    uint8_t core;
+    TraceStage stage;
+    TracePhase phase;
+    uint16_t arg;
+} traceEvent_s;
+
+// Unwraps one core's cycle counter across all the dumps in a capture
+typedef struct coreClock_t
+{
+    bool isStarted;
+    uint32_t lastCycles;
+    uint64_t cycles;
+} coreClock_s;
+
+static bool ReadCapture(const char *path, std::vector<uint8_t> *capture);
+static uint32_t DecodeDumps(const std::vector<uint8_t> &capture, std::vector<traceEvent_t> *events);
+static void PrintLatencies(const std::vector<traceEvent_t> &events);
+static void PrintStageLatencies(const char *name, std::vector<double> *durations_us);
+static bool WriteChromeTrace(const char *path, const std::vector<traceEvent_t> &events);
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <capture.bin> [trace.json]\n", argv[0]);
+        return 1;
+    }
+    std::vector<uint8_t> capture;
+    if (!ReadCapture(argv[1], &capture))
+    {
+        return 1;
+    }
+    std::vector<traceEvent_t> events;
+    const uint32_t droppedCount = DecodeDumps(capture, &events);
+    if (events.empty())
+    {
+        fprintf(stderr, "No trace records found in %s\n", argv[1]);
+        return 1;
+    }
+    printf("%zu records, %u dropped before they were dumped\n", events.size(), droppedCount);
+    PrintLatencies(events);
+    if (argc > 2 && !WriteChromeTrace(argv[2], events))
+    {
+        return 1;
+    }
+    return 0;
+}
+
+static bool ReadCapture(const char *path, std::vector<uint8_t> *capture)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Could not open %s\n", path);
+        return false;
+    }
+    uint8_t chunk[4096];
+    size_t bytesRead;
+    while ((bytesRead = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    {
+        capture->insert(capture->end(), chunk, chunk + bytesRead);
+    }
+    fclose(file);
+    return true;
+}
+
+// Append the records of every dump to events in time order, returns the total dropped
+static uint32_t DecodeDumps(const std::vector<uint8_t> &capture, std::vector<traceEvent_t> *events)
+{
+    coreClock_t clocks[256] = {};
+    uint32_t droppedCount = 0;
+    size_t offset = 0;
+    while (offset + sizeof(traceDumpHeader_t) <= capture.size())
+    {
+        if (memcmp(&capture[offset], TRACE_DUMP_MAGIC, 4) != 0)
+        {
+            ++offset;
+            continue;
+        }
+        traceDumpHeader_t header;
+        memcpy(&header, &capture[offset], sizeof(header));
+        const size_t recordBytes = (size_t)header.recordCount * sizeof(traceRecord_t);
+        const bool isValid = (header.version == TRACE_FORMAT_VERSION) && (header.cyclesPerMicro != 0) &&
+                             (offset + sizeof(header) + recordBytes <= capture.size());
+        if (!isValid)
+        {
+            ++offset;
+            continue;
+        }
+        offset += sizeof(header);
+        droppedCount += header.droppedCount;
+
+        coreClock_t *clock = &clocks[header.core];
+        for (uint32_t i = 0; i < header.recordCount; ++i)
+        {
+            traceRecord_t record;
+            memcpy(&record, &capture[offset + i * sizeof(record)], sizeof(record));
+            if (!clock->isStarted)
+            {
+                clock->isStarted = true;
+                clock->cycles = record.timestamp_cycles;
+            }
+            else
+            {
+                clock->cycles += (uint32_t)(record.timestamp_cycles - clock->lastCycles);
+            }
+            clock->lastCycles = record.timestamp_cycles;
+            if ((uint32_t)record.stage >= (uint32_t)TraceStage::stage_count)
+            {
+                continue;
+            }
+            events->push_back({(double)clock->cycles / header.cyclesPerMicro, header.core, record.stage, record.phase, record.arg});
+        }
+        offset += recordBytes;
+    }
+
+    // Both cores' counters run from reset, so they line up closely enough to share an origin
+    double firstTime_us = INFINITY;
+    for (const traceEvent_t &event : *events)
+    {
+        firstTime_us = std::min(firstTime_us, event.time_us);
+    }
+    for (traceEvent_t &event : *events)
+    {
+        event.time_us -= firstTime_us;
+    }
+    std::stable_sort(events->begin(), events->end(),
+                     [](const traceEvent_t &a, const traceEvent_t &b) { return a.time_us < b.time_us; });
+    return droppedCount;
+}
+
+static void PrintLatencies(const std::vector<traceEvent_t> &events)
+{
+    const uint32_t stageCount = (uint32_t)TraceStage::stage_count;
+    std::vector<double> durations_us[(uint32_t)TraceStage::stage_count];
+    // Start of the open span of each stage on each core, negative when none is open
+    std::vector<double> beginTime_us(256 * stageCount, -1);
+    uint32_t instantCount[(uint32_t)TraceStage::stage_count] = {};
+    for (const traceEvent_t &event : events)
+    {
+        const uint32_t stage = (uint32_t)event.stage;
+        double *openBegin_us = &beginTime_us[event.core * stageCount + stage];
+        if (event.phase == TracePhase::begin)
+        {
+            *openBegin_us = event.time_us;
+        }
+        else if (event.phase == TracePhase::end && *openBegin_us >= 0)
+        {
+            durations_us[stage].push_back(event.time_us - *openBegin_us);
+            *openBegin_us = -1;
+        }
+        else if (event.phase == TracePhase::instant)
+        {
+            ++instantCount[stage];
+        }
+    }
+
+    for (uint32_t stage = 0; stage < stageCount; ++stage)
+    {
+        if (!durations_us[stage].empty())
+        {
+            PrintStageLatencies(traceStageNames[stage], &durations_us[stage]);
+        }
+        else if (instantCount[stage] > 0)
+        {
+            printf("\n%s: %u events\n", traceStageNames[stage], instantCount[stage]);
+        }
+    }
+}
+
+static void PrintStageLatencies(const char *name, std::vector<double> *durations_us)
+{
+    std::sort(durations_us->begin(), durations_us->end());
+    const size_t count = durations_us->size();
+    double sum_us = 0;
+    uint32_t buckets[HISTOGRAM_BUCKET_COUNT] = {};
+    for (const double duration_us : *durations_us)
+    {
+        sum_us += duration_us;
+        int bucket = (duration_us < 1) ? 0 : 1 + (int)log2(duration_us);
+        buckets[std::min(bucket, HISTOGRAM_BUCKET_COUNT - 1)]++;
+    }
+    const auto percentile = [&](double fraction) { return (*durations_us)[(size_t)(fraction * (count - 1))]; };
+    printf("\n%s: %zu spans, min %.1f us, mean %.1f us, p50 %.1f us, p90 %.1f us, p99 %.1f us, max %.1f us\n",
+           name, count, durations_us->front(), sum_us / count, percentile(0.5), percentile(0.9), percentile(0.99),
+           durations_us->back());
+
+    const uint32_t largestBucket = *std::max_element(buckets, buckets + HISTOGRAM_BUCKET_COUNT);
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKET_COUNT; ++bucket)
+    {
+        if (buckets[bucket] == 0)
+        {
+            continue;
+        }
+        const double lower_us = (bucket == 0) ? 0 : ldexp(1, bucket - 1);
+        char bar[HISTOGRAM_BAR_WIDTH + 1];
+        const int barLength = std::max(1, (int)((uint64_t)buckets[bucket] * HISTOGRAM_BAR_WIDTH / largestBucket));
+        memset(bar, '#', barLength);
+        bar[barLength] = '\0';
+        if (bucket == HISTOGRAM_BUCKET_COUNT - 1)
+        {
+            printf("  %8.0f us +        %8u %s\n", lower_us, buckets[bucket], bar);
+        }
+        else
+        {
+            printf("  %8.0f-%-8.0f us %8u %s\n", lower_us, ldexp(1, bucket), buckets[bucket], bar);
+        }
+    }
+}
+
+static bool WriteChromeTrace(const char *path, const std::vector<traceEvent_t> &events)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Could not open %s for writing\n", path);
+        return false;
+    }
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    bool hasCore[256] = {};
+    for (const traceEvent_t &event : events)
+    {
+        hasCore[event.core] = true;
+    }
+    const char *separator = "";
+    for (uint32_t core = 0; core < 256; ++core)
+    {
+        if (hasCore[core])
+        {
+            fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %u, \"args\": {\"name\": \"core %u\"}}",
+                    separator, core, core);
+            separator = ",\n";
+        }
+    }
+    for (const traceEvent_t &event : events)
+    {
+        const char *name = traceStageNames[(uint32_t)event.stage];
+        switch (event.phase)
+        {
+        case TracePhase::begin:
+            fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"B\", \"ts\": %.3f, \"pid\": 0, \"tid\": %u}", separator, name, event.time_us, event.core);
+            break;
+        case TracePhase::end:
+            fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"E\", \"ts\": %.3f, \"pid\": 0, \"tid\": %u}", separator, name, event.time_us, event.core);
+            break;
+        case TracePhase::instant:
+            fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"i\", \"s\": \"t\", \"ts\": %.3f, \"pid\": 0, \"tid\": %u, \"args\": {\"arg\": %u}}",
+                    separator, name, event.time_us, event.core, event.arg);
+            break;
+        }
+        separator = ",\n";
+    }
+    fprintf(file, "\n]}\n");
+    fclose(file);
+    printf("\nWrote %zu events to %s\n", events.size(), path);
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef OUTPUT_STAGE_H
+#define OUTPUT_STAGE_H
+
+#include <FastLED.h>
+
+// Turns the composited frame into what the LEDs are sent. Each channel is gamma corrected
+// to 16 bit linear light through a table in flash and scaled by the brightness, then the
+// part below 8 bits is carried from frame to frame so that over a few frames each LED
+// averages the 16 bit value. Dim fades keep their shape instead of banding and snapping
+// off. Costs one table read and a few integer operations per channel, every frame sent.
+// FastLED's own brightness and dithering are left off, this does both.
+
+// Uncomment to send the gamma corrected value rounded down each frame, without dithering
+// #define OUTPUT_DITHER_DISABLED
+
+// Scale applied after gamma correction, 255 for full
+void SetOutputBrightness(uint8_t brightness);
+
+// Convert count LEDs of the frame into out, call once for each frame that may be sent.
+// Returns false if out was already exactly that, so the LEDs are already showing it.
+bool RenderOutput(CRGB *out, const CRGB *frame, uint16_t count);
+
+#endif // OUTPUT_STAGE_H
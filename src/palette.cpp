@@ -0,0 +1,184 @@
+#include "palette.h"
+
+// Palettes are indexed by the Colour value, they are the controller's keypad indices
+#define PALETTE_LOOKUP_LENGTH (MAX_COLOUR_KEYPAD_INDEX + 1)
+// Entry of the middle colour, so PALETTE_SECONDARY lands on it exactly
+#define PALETTE_MIDDLE_ENTRY (PALETTE_SECONDARY >> 4)
+
+typedef struct paletteEntry_t
+{
+    uint8_t r;
+    uint8_t g;
+    uint8_t b;
+} paletteEntry_s;
+
+typedef struct palette_t
+{
+    paletteEntry_t entries[PALETTE_SIZE];
+} palette_s;
+
+// The colours a palette runs through, primary to accent, as 0xRRGGBB
+typedef struct paletteStops_t
+{
+    Colour colour;
+    uint32_t primary;
+    uint32_t secondary;
+    uint32_t accent;
+} paletteStops_s;
+
+// One entry per Colour, the only place a palette is defined
+static constexpr paletteStops_t paletteStops[] = {
+    {Colour::red, CRGB::Red, CRGB::Red, CRGB::Red},
+    {Colour::blue, CRGB::Blue, CRGB::Blue, CRGB::Blue},
+    {Colour::green, CRGB::Green, CRGB::Green, CRGB::Green},
+    {Colour::purple, CRGB::Purple, CRGB::Purple, CRGB::Purple},
+    {Colour::white, CRGB::White, CRGB::White, CRGB::White},
+    {Colour::yellow, CRGB::Yellow, CRGB::Yellow, CRGB::Yellow},
+    {Colour::orange, CRGB::OrangeRed, CRGB::OrangeRed, CRGB::OrangeRed},
+    {Colour::red_white, CRGB::Red, CRGB::Red, CRGB::White},
+    {Colour::green_white, CRGB::Green, CRGB::Green, CRGB::White},
+    {Colour::blue_white, CRGB::Blue, CRGB::Blue, CRGB::White},
+    {Colour::cb, CRGB::OrangeRed, CRGB::Green, CRGB::Purple},
+    {Colour::cd, CRGB::Yellow, CRGB::Blue, CRGB::Purple},
+    {Colour::fire, CRGB::Yellow, CRGB::Red, CRGB::OrangeRed},
+    {Colour::purue, CRGB::Purple, CRGB::Red, CRGB::Blue},
+    {Colour::blue_red, CRGB::Blue, CRGB::Blue, CRGB::Red},
+};
+#define PALETTE_STOPS_COUNT (sizeof(paletteStops) / sizeof(paletteStops[0]))
+
+typedef struct paletteTable_t
+{
+    palette_t palettes[PALETTE_LOOKUP_LENGTH];
+    bool hasPalette[PALETTE_LOOKUP_LENGTH];
+    bool isValid; // Every entry in range and registered once
+} paletteTable_s;
+
+static constexpr uint8_t LerpChannel(uint32_t from, uint32_t to, int shift, int step, int steps)
+{
+    const int a = (from >> shift) & 0xFF;
+    const int b = (to >> shift) & 0xFF;
+    return (uint8_t)(a + (b - a) * step / steps);
+}
+
+static constexpr paletteEntry_t LerpEntry(uint32_t from, uint32_t to, int step, int steps)
+{
+    return {LerpChannel(from, to, 16, step, steps), LerpChannel(from, to, 8, step, steps), LerpChannel(from, to, 0, step, steps)};
+}
+
+static constexpr palette_t BuildGradient(const paletteStops_t &stops)
+{
+    palette_t palette = {};
+    for (int i = 0; i <= PALETTE_MIDDLE_ENTRY; ++i)
+    {
+        palette.entries[i] = LerpEntry(stops.primary, stops.secondary, i, PALETTE_MIDDLE_ENTRY);
+    }
+    for (int i = PALETTE_MIDDLE_ENTRY; i < PALETTE_SIZE; ++i)
+    {
+        palette.entries[i] = LerpEntry(stops.secondary, stops.accent, i - PALETTE_MIDDLE_ENTRY, PALETTE_SIZE - 1 - PALETTE_MIDDLE_ENTRY);
+    }
+    return palette;
+}
+
+static constexpr paletteTable_t BuildPaletteTable()
+{
+    paletteTable_t table = {};
+    table.isValid = true;
+    for (uint32_t i = 0; i < PALETTE_STOPS_COUNT; ++i)
+    {
+        const int value = (int)paletteStops[i].colour;
+        if (value < 0 || value >= PALETTE_LOOKUP_LENGTH || table.hasPalette[value])
+        {
+            table.isValid = false;
+            continue;
+        }
+        table.palettes[value] = BuildGradient(paletteStops[i]);
+        table.hasPalette[value] = true;
+    }
+    return table;
+}
+
+// constexpr, so the table is in flash rather than built in RAM at boot
+static constexpr paletteTable_t paletteTable = BuildPaletteTable();
+static_assert(paletteTable.isValid, "Register every palette once, with a value below PALETTE_LOOKUP_LENGTH");
+
+// What the effects sample, and the blend that is building it
+static CRGB activePalette[PALETTE_SIZE];
+static CRGB fromPalette[PALETTE_SIZE];
+static const palette_t *toPalette = nullptr;
+static uint32_t transitionLength_ms = 0;
+static uint32_t transitionElapsed_ms = 0;
+static uint32_t paletteVersion = 0;
+
+static CRGB EntryColour(const paletteEntry_t &entry);
+static CRGB BlendColour(const CRGB &from, const CRGB &to, uint16_t weight);
+
+void PaletteInit(Colour colour)
+{
+    SetPalette(colour, 0);
+    UpdatePalette(0);
+}
+
+void SetPalette(Colour colour, uint32_t transition_ms)
+{
+    const uint8_t value = (uint8_t)colour;
+    if (value >= PALETTE_LOOKUP_LENGTH || !paletteTable.hasPalette[value])
+    {
+        return;
+    }
+    // A blend cut short carries on from wherever it had got to
+    memcpy(fromPalette, activePalette, sizeof(fromPalette));
+    toPalette = &paletteTable.palettes[value];
+    transitionLength_ms = transition_ms;
+    transitionElapsed_ms = 0;
+}
+
+void UpdatePalette(uint32_t dt_ms)
+{
+    if (toPalette == nullptr)
+    {
+        return;
+    }
+    transitionElapsed_ms += dt_ms;
+    ++paletteVersion;
+    if (transitionElapsed_ms >= transitionLength_ms)
+    {
+        for (uint32_t i = 0; i < PALETTE_SIZE; ++i)
+        {
+            activePalette[i] = EntryColour(toPalette->entries[i]);
+        }
+        toPalette = nullptr;
+        return;
+    }
+    const uint16_t weight = (uint16_t)(transitionElapsed_ms * 256 / transitionLength_ms);
+    for (uint32_t i = 0; i < PALETTE_SIZE; ++i)
+    {
+        activePalette[i] = BlendColour(fromPalette[i], EntryColour(toPalette->entries[i]), weight);
+    }
+}
+
+CRGB PaletteColour(uint8_t position)
+{
+    // The top 4 bits pick the entry, the low 4 how far towards the next one. The last entry
+    // does not wrap back to the first, so PALETTE_ACCENT is the accent colour exactly.
+    const uint8_t index = position >> 4;
+    const uint8_t next = (index == PALETTE_SIZE - 1) ? index : index + 1;
+    return BlendColour(activePalette[index], activePalette[next], (position & 0x0F) << 4);
+}
+
+uint32_t PaletteVersion()
+{
+    return paletteVersion;
+}
+
+static CRGB EntryColour(const paletteEntry_t &entry)
+{
+    return CRGB(entry.r, entry.g, entry.b);
+}
+
+// weight out of 256
+static CRGB BlendColour(const CRGB &from, const CRGB &to, uint16_t weight)
+{
+    return CRGB((uint8_t)((from.r * (256 - weight) + to.r * weight) >> 8),
+                (uint8_t)((from.g * (256 - weight) + to.g * weight) >> 8),
+                (uint8_t)((from.b * (256 - weight) + to.b * weight) >> 8));
+}
@@ -0,0 +1,38 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <FastLED.h>
+
+#include "interface.h"
+
+// Every Colour the controller can send is a 16 entry gradient built at compile time, so the
+// tables live in flash. Effects sample the active palette by position instead of holding
+// colours, and a new palette blends in from the old one rather than snapping.
+
+#define PALETTE_SIZE 16
+// How long a palette change from the controller takes to blend in
+#define PALETTE_TRANSITION_MS 500
+
+// Where the effects sample, the palette's main colour, its second and its accent. Each is
+// exactly one of the colours the palette was built from.
+#define PALETTE_PRIMARY 0
+#define PALETTE_SECONDARY 128
+#define PALETTE_ACCENT 255
+
+// Show the palette straight away, call once before rendering
+void PaletteInit(Colour colour);
+
+// Start blending towards the colour's palette from whatever is showing now. Colours with no
+// palette are ignored.
+void SetPalette(Colour colour, uint32_t transition_ms);
+
+// Move any blend on by dt_ms, call once a frame before the effects draw
+void UpdatePalette(uint32_t dt_ms);
+
+// Colour at a position along the active palette, interpolating between its entries
+CRGB PaletteColour(uint8_t position);
+
+// Changes whenever the active palette does, for caches of colours taken from it
+uint32_t PaletteVersion();
+
+#endif // PALETTE_H
@@ -0,0 +1,54 @@
+#include "pattern_sprite.h"
+
+#include <string.h>
+
+#include "led_geometry.h"
+#include "palette.h"
+
+PatternSprite::PatternSprite(patternFunction_t patternFunction)
+    : pattern(patternFunction), paletteVersion(0), isBuilt(false)
+{
+}
+
+void PatternSprite::BlitRow(ledCanvas_t *canvas, uint16_t y)
+{
+    Refresh();
+    // A row is one run of the strip and the sprite is in strip order, so it copies straight over
+    const ledSpan_t row = HatGeometry::Row(y);
+    memcpy(&canvas->pixels[row.first], &pixels[row.first], row.length * sizeof(CRGB));
+    MarkLit(canvas, row);
+}
+
+void PatternSprite::BlitColumn(ledCanvas_t *canvas, uint16_t x)
+{
+    Refresh();
+    for (const uint16_t index : HatGeometry::Column(x))
+    {
+        canvas->pixels[index] = pixels[index];
+    }
+    MarkLit(canvas, HatGeometry::ColumnSpan(x));
+}
+
+void PatternSprite::Blit(ledCanvas_t *canvas)
+{
+    Refresh();
+    memcpy(canvas->pixels, pixels, sizeof(pixels));
+    MarkLit(canvas, {0, NUM_LEDS});
+}
+
+void PatternSprite::Refresh()
+{
+    if (isBuilt && paletteVersion == PaletteVersion())
+    {
+        return;
+    }
+    for (uint16_t y = 0; y < HatGeometry::height; ++y)
+    {
+        for (uint16_t x = 0; x < HatGeometry::width; ++x)
+        {
+            pixels[HatGeometry::Index(x, y)] = PaletteColour(pattern(x, y));
+        }
+    }
+    paletteVersion = PaletteVersion();
+    isBuilt = true;
+}
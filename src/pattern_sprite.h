@@ -0,0 +1,36 @@
+#ifndef PATTERN_SPRITE_H
+#define PATTERN_SPRITE_H
+
+#include <FastLED.h>
+
+#include "config.h"
+#include "led_canvas.h"
+
+// A fixed pattern over the whole matrix, given as a palette position for each LED, cached
+// as colours in strip order. The cache is rebuilt on the first blit after the palette
+// changes, otherwise a row is one memcpy and a column one copy per LED. Patterned effects
+// draw by blitting parts of a sprite instead of working out each LED's colour.
+
+// Palette position of the LED at x, y
+typedef uint8_t (*patternFunction_t)(uint16_t x, uint16_t y);
+
+class PatternSprite
+{
+public:
+    explicit PatternSprite(patternFunction_t patternFunction);
+
+    void BlitRow(ledCanvas_t *canvas, uint16_t y);
+    void BlitColumn(ledCanvas_t *canvas, uint16_t x);
+    void Blit(ledCanvas_t *canvas);
+
+private:
+    void Refresh();
+
+    const patternFunction_t pattern;
+    // Palette the cache was built from, see PaletteVersion()
+    uint32_t paletteVersion;
+    bool isBuilt;
+    CRGB pixels[NUM_LEDS];
+};
+
+#endif // PATTERN_SPRITE_H
@@ -1,16 +1,78 @@
 #include "profiling.h"
 
-#include <arduino.h>
+#include <Arduino.h>
 #include "beat_detection.h"
 
-#include "driver/i2s.h"
+traceRing_t traceRings[TRACE_CORE_COUNT];
+volatile bool isTracePaused = false;
 
-#define FFT_SQRT_APPROXIMATION
-#define FFT_SPEED_OVER_PRECISION
-#include <arduinoFFT.h>
+static void SerialTraceWriter(const uint8_t *bytes, size_t length);
 
-int64_t lastProfilingPoint_ms;
-int64_t microsNow;
+void TraceDump(traceWriter_t write)
+{
+    // Copied out so recording can carry on while the slow write runs
+    static traceRecord_t dumpRecords[TRACE_RING_LENGTH];
+    for (uint32_t core = 0; core < TRACE_CORE_COUNT; ++core)
+    {
+        traceRing_t *ring = &traceRings[core];
+        // Only cuts down the records lost to the copy, a TraceRecord() already past the check
+        // on the other core still writes
+        isTracePaused = true;
+        const uint32_t writeIndex = ring->writeIndex.load(std::memory_order_acquire);
+        const uint32_t pendingCount = writeIndex - ring->dumpedIndex;
+        // One short of the ring, as the oldest slot is the next one written
+        const uint32_t copiedCount = (pendingCount < TRACE_RING_LENGTH - 1) ? pendingCount : TRACE_RING_LENGTH - 1;
+        for (uint32_t i = 0; i < copiedCount; ++i)
+        {
+            dumpRecords[i] = ring->records[(writeIndex - copiedCount + i) & (TRACE_RING_LENGTH - 1)];
+        }
+        // Records started since writeIndex was read, including one still being written, reuse
+        // the slots of the oldest ones. Any of those copied are dropped rather than sent torn.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint32_t startedCount = ring->writeIndex.load(std::memory_order_relaxed) - writeIndex;
+        const uint32_t reachedCount = (startedCount + copiedCount > TRACE_RING_LENGTH - 1) ? startedCount + copiedCount - (TRACE_RING_LENGTH - 1) : 0;
+        const uint32_t overwrittenCount = (reachedCount < copiedCount) ? reachedCount : copiedCount;
+        const uint32_t recordCount = copiedCount - overwrittenCount;
+        ring->dumpedIndex = writeIndex;
+        isTracePaused = false;
+
+        traceDumpHeader_t header;
+        memcpy(header.magic, TRACE_DUMP_MAGIC, sizeof(header.magic));
+        header.version = TRACE_FORMAT_VERSION;
+        header.core = core;
+        header.cyclesPerMicro = GetCyclesPerMicro();
+        header.recordCount = recordCount;
+        header.droppedCount = pendingCount - recordCount;
+        write((const uint8_t *)&header, sizeof(header));
+        write((const uint8_t *)&dumpRecords[overwrittenCount], recordCount * sizeof(traceRecord_t));
+    }
+}
+
+void TraceService()
+{
+    bool isDumpRequested = false;
+    while (Serial.available() > 0)
+    {
+        isDumpRequested |= (Serial.read() == TRACE_DUMP_COMMAND);
+    }
+#ifdef TRACE_DUMP_PERIOD_MS
+    static int64_t lastDumpTime_ms = 0;
+    if (GetMillis() - lastDumpTime_ms >= TRACE_DUMP_PERIOD_MS)
+    {
+        lastDumpTime_ms = GetMillis();
+        isDumpRequested = true;
+    }
+#endif
+    if (isDumpRequested)
+    {
+        TraceDump(SerialTraceWriter);
+    }
+}
+
+static void SerialTraceWriter(const uint8_t *bytes, size_t length)
+{
+    Serial.write(bytes, length);
+}
 
 // Print various data for debugging
 void PrintVector(float *vData, uint16_t bufferSize, uint8_t scaleType)
@@ -25,10 +87,10 @@ void PrintVector(float *vData, uint16_t bufferSize, uint8_t scaleType)
             abscissa = (i * 1.0);
             break;
         case SCL_TIME:
-            abscissa = ((i * 1.0) / SAMPLING_FREQUENCY_HZ);
+            abscissa = ((i * 1.0) / ANALYSIS_FREQUENCY_HZ);
             break;
         case SCL_FREQUENCY:
-            abscissa = ((i * 1.0 * SAMPLING_FREQUENCY_HZ) / FFT_BUFFER_LENGTH);
+            abscissa = ((i * 1.0 * ANALYSIS_FREQUENCY_HZ) / FFT_BUFFER_LENGTH);
             break;
         }
         Serial.print(abscissa, 6);
@@ -1,9 +1,11 @@
 #ifndef PROFILING_H
 #define PROFILING_H
 
-#include <arduino.h>
+#include <Arduino.h>
+#include <atomic>
 
 #include "timing.h"
+#include "trace_format.h"
 
 #define SCL_INDEX 0x00
 #define SCL_TIME 0x01
@@ -12,49 +14,75 @@
 
 // Uncomment to enable print debugging (only enable one at a time)
 // #define OUTPUT_AUDIO
-// #define TIME_PROFILING
 // #define PRINT_BIN_MAGNITUDES
 // #define PRINT_NOT_BEAT_DETECTED_REASON
 // #define PRINT_CURRENT_BASS_MAG
-// #define PROFILE_MIC_READ
-// #define BEAT_DETECTION_PROFILING
 
+// Uncomment to record the pipeline stages into a RAM ring on each core. Send TRACE_DUMP_COMMAND
+// over serial to dump it, then decode the capture with env:trace_decode.
+// #define TRACE_ENABLED
+// Uncomment to also dump every TRACE_DUMP_PERIOD_MS without being asked
+// #define TRACE_DUMP_PERIOD_MS 5000
+#define TRACE_DUMP_COMMAND 't'
+// Records kept per core, a power of two
+#define TRACE_RING_LENGTH 1024
+#define TRACE_CORE_COUNT 2
 
+// Uncomment to print the load of each core and task, stack headroom, free heap and loop rates
+// every RUNTIME_STATS_PERIOD_MS, see runtime_stats.h
+// #define RUNTIME_STATS_ENABLED
+#define RUNTIME_STATS_PERIOD_MS 2000
 
-extern int64_t lastProfilingPoint_ms;
-extern int64_t microsNow;
-
-#ifdef TIME_PROFILING
-#define BPS_PROFILING
-#define EMIT_PROFILING_EVENT {\
-    microsNow = GetMicros();\
-    Serial.print(microsNow - lastProfilingPoint_ms);\
-    Serial.print("\t");\
-    lastProfilingPoint_ms = microsNow;\
-}
-#else
-#define EMIT_PROFILING_EVENT do { } while(0)
-#endif // TIME_PROFILING
-
-#ifdef PROFILE_MIC_READ
-#define EMIT_MIC_READ_EVENT {\
-    microsNow = GetMicros();\
-    Serial.println(microsNow - lastProfilingPoint_ms);\
-    lastProfilingPoint_ms = microsNow;\
-}
+#ifdef TRACE_ENABLED
+#define TRACE_BEGIN(stage) TraceRecord(stage, TracePhase::begin, 0)
+#define TRACE_END(stage) TraceRecord(stage, TracePhase::end, 0)
+#define TRACE_INSTANT(stage, arg) TraceRecord(stage, TracePhase::instant, arg)
 #else
-#define EMIT_MIC_READ_EVENT do { } while(0)
-#endif // PROFILE_MIC_READ
-
-#ifdef BEAT_DETECTION_PROFILING
-#define BPS_PROFILING
-#define EMIT_DETECTION_EVENT (DETECTION_CONDITION) {\
-    Serial.print(DETECTION_CONDITION);\
-    Serial.print("\t");\
+#define TRACE_BEGIN(stage) do { } while(0)
+#define TRACE_END(stage) do { } while(0)
+#define TRACE_INSTANT(stage, arg) do { } while(0)
+#endif // TRACE_ENABLED
+
+// Each core only ever writes its own ring, so recording needs no locks. writeIndex is
+// published with a release store so the dump sees whole records up to it.
+// Only trace from tasks pinned to one core, never from an ISR.
+typedef struct traceRing_t
+{
+    traceRecord_t records[TRACE_RING_LENGTH];
+    std::atomic<uint32_t> writeIndex;
+    uint32_t dumpedIndex;
+} traceRing_s;
+
+static_assert((TRACE_RING_LENGTH & (TRACE_RING_LENGTH - 1)) == 0, "TRACE_RING_LENGTH must be a power of two");
+
+extern traceRing_t traceRings[TRACE_CORE_COUNT];
+extern volatile bool isTracePaused;
+
+// Read the cycle counter and store one record, a handful of instructions
+inline void TraceRecord(TraceStage stage, TracePhase phase, uint16_t arg)
+{
+    if (isTracePaused)
+    {
+        return;
+    }
+    traceRing_t *ring = &traceRings[GetCoreId()];
+    const uint32_t writeIndex = ring->writeIndex.load(std::memory_order_relaxed);
+    traceRecord_t *record = &ring->records[writeIndex & (TRACE_RING_LENGTH - 1)];
+    record->timestamp_cycles = GetCycleCount();
+    record->stage = stage;
+    record->phase = phase;
+    record->arg = arg;
+    ring->writeIndex.store(writeIndex + 1, std::memory_order_release);
 }
-#else
-#define EMIT_DETECTION_EVENT () do { } while(0)
-#endif // TIME_PROFILING
+
+typedef void (*traceWriter_t)(const uint8_t *bytes, size_t length);
+
+// Write every record not dumped before, one block per core, see trace_format.h
+void TraceDump(traceWriter_t write);
+
+// Dump over serial when asked, or every TRACE_DUMP_PERIOD_MS. Call from a low priority task,
+// the recording is only asked to pause while each ring is copied, not while it is sent.
+void TraceService();
 
 void PrintVector(float *, uint16_t, uint8_t);
 
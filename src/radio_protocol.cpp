@@ -0,0 +1,370 @@
+#include "radio_protocol.h"
+
+#define RADIO_HEADER_BYTES 4
+#define RADIO_CRC_BYTES 1
+
+#define FIELD_EFFECT 0x01
+#define FIELD_COLOUR 0x02
+#define FIELD_BRIGHTNESS 0x04
+#define FIELD_BEAT_LENGTH 0x08
+#define FIELD_ALL (FIELD_EFFECT | FIELD_COLOUR | FIELD_BRIGHTNESS | FIELD_BEAT_LENGTH)
+#define FLAG_EFFECT_COMMAND 0x10
+#define FLAG_AMBIENT_OVERRIDE 0x20
+
+static_assert(RADIO_MAX_PACKET_BYTES == RADIO_HEADER_BYTES + 1 + 5 + RADIO_CRC_BYTES, "RADIO_MAX_PACKET_BYTES must fit a full state");
+
+typedef struct radioHeader_t
+{
+    RadioPacketType type;
+    uint8_t session;
+    uint16_t sequence;
+} radioHeader_s;
+
+// CRC-8, polynomial 0x07. Packets are a few bytes so a bitwise loop is plenty.
+static uint8_t Crc8(const uint8_t *data, uint8_t length)
+{
+    uint8_t crc = 0;
+    for (uint8_t i = 0; i < length; ++i)
+    {
+        crc ^= data[i];
+        for (uint8_t bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint8_t WriteHeader(uint8_t *packet, RadioPacketType type, uint8_t session, uint16_t sequence)
+{
+    packet[0] = (uint8_t)((RADIO_PROTOCOL_VERSION << 4) | static_cast<uint8_t>(type));
+    packet[1] = session;
+    packet[2] = (uint8_t)(sequence & 0xFF);
+    packet[3] = (uint8_t)(sequence >> 8);
+    return RADIO_HEADER_BYTES;
+}
+
+static uint8_t AppendCrc(uint8_t *packet, uint8_t length)
+{
+    packet[length] = Crc8(packet, length);
+    return length + RADIO_CRC_BYTES;
+}
+
+// Checks the length, CRC and version. Returns the payload length, or -1 if the packet is bad.
+static int ReadHeader(const uint8_t *packet, int length, radioHeader_t *header)
+{
+    if (length < RADIO_HEADER_BYTES + RADIO_CRC_BYTES || length > RADIO_MAX_PACKET_BYTES)
+    {
+        return -1;
+    }
+    if (Crc8(packet, (uint8_t)(length - RADIO_CRC_BYTES)) != packet[length - RADIO_CRC_BYTES])
+    {
+        return -1;
+    }
+    if ((packet[0] >> 4) != RADIO_PROTOCOL_VERSION || (packet[0] & 0x0F) > static_cast<uint8_t>(RadioPacketType::stale))
+    {
+        return -1;
+    }
+    header->type = static_cast<RadioPacketType>(packet[0] & 0x0F);
+    header->session = packet[1];
+    header->sequence = (uint16_t)(packet[2] | (packet[3] << 8));
+    return length - RADIO_HEADER_BYTES - RADIO_CRC_BYTES;
+}
+
+// A full state if base is NULL, otherwise only the fields that differ from it
+static uint8_t EncodeState(uint8_t *packet, const radioData_t &state, const radioData_t *base, uint8_t session, uint16_t sequence)
+{
+    uint8_t fields = FIELD_ALL;
+    if (base != NULL)
+    {
+        fields = (state.effect != base->effect ? FIELD_EFFECT : 0) |
+                 (state.colour != base->colour ? FIELD_COLOUR : 0) |
+                 (state.brightness != base->brightness ? FIELD_BRIGHTNESS : 0) |
+                 (state.beatLength_ms != base->beatLength_ms ? FIELD_BEAT_LENGTH : 0);
+    }
+    uint8_t length = WriteHeader(packet, (base == NULL) ? RadioPacketType::full_state : RadioPacketType::delta_state, session, sequence);
+    uint8_t *fieldByte = &packet[length++];
+    *fieldByte = fields |
+                 (state.isEffectCommand ? FLAG_EFFECT_COMMAND : 0) |
+                 (state.ambientOverride ? FLAG_AMBIENT_OVERRIDE : 0);
+    if (fields & FIELD_EFFECT)
+    {
+        packet[length++] = (uint8_t)state.effect;
+    }
+    if (fields & FIELD_COLOUR)
+    {
+        packet[length++] = (uint8_t)state.colour;
+    }
+    if (fields & FIELD_BRIGHTNESS)
+    {
+        packet[length++] = state.brightness;
+    }
+    if (fields & FIELD_BEAT_LENGTH)
+    {
+        packet[length++] = (uint8_t)(state.beatLength_ms & 0xFF);
+        packet[length++] = (uint8_t)(state.beatLength_ms >> 8);
+    }
+    return AppendCrc(packet, length);
+}
+
+// Applies the payload's fields over state. Returns false, leaving state alone, if the payload
+// length does not match its field byte or a full state is missing fields.
+static bool DecodeState(const uint8_t *payload, int payloadLength, bool isFullState, radioData_t *state)
+{
+    if (payloadLength < 1)
+    {
+        return false;
+    }
+    const uint8_t fields = payload[0];
+    if (isFullState && (fields & FIELD_ALL) != FIELD_ALL)
+    {
+        return false;
+    }
+    const int expectedLength = 1 +
+                               ((fields & FIELD_EFFECT) ? 1 : 0) +
+                               ((fields & FIELD_COLOUR) ? 1 : 0) +
+                               ((fields & FIELD_BRIGHTNESS) ? 1 : 0) +
+                               ((fields & FIELD_BEAT_LENGTH) ? 2 : 0);
+    if (payloadLength != expectedLength)
+    {
+        return false;
+    }
+    int index = 1;
+    state->isEffectCommand = (fields & FLAG_EFFECT_COMMAND) != 0;
+    state->ambientOverride = (fields & FLAG_AMBIENT_OVERRIDE) != 0;
+    if (fields & FIELD_EFFECT)
+    {
+        state->effect = (int8_t)payload[index++];
+    }
+    if (fields & FIELD_COLOUR)
+    {
+        state->colour = (int8_t)payload[index++];
+    }
+    if (fields & FIELD_BRIGHTNESS)
+    {
+        state->brightness = payload[index++];
+    }
+    if (fields & FIELD_BEAT_LENGTH)
+    {
+        state->beatLength_ms = (uint16_t)(payload[index] | (payload[index + 1] << 8));
+    }
+    return true;
+}
+
+//-------------- Sender --------------
+
+RadioSender::RadioSender(RadioTransport *transport, uint8_t session)
+    : transport(transport),
+      session(session)
+{
+}
+
+void RadioSender::Update(const radioData_t &state, uint32_t now_ms)
+{
+    // Only a hat ahead of everything sent so far means an earlier boot's sequence, a stale
+    // reply to a late retransmit from this boot is behind nextSequence and ignored
+    const uint16_t staleHatSequence = hatSequence.exchange(0, std::memory_order_acquire);
+    if (staleHatSequence != 0 && (int16_t)(staleHatSequence - nextSequence) >= 0)
+    {
+        nextSequence = (staleHatSequence == UINT16_MAX) ? 1 : staleHatSequence + 1;
+        isInFlight = false;
+        isAckedStateValid = false;
+        isBackingOff = false;
+        ++stats.sequenceSkipCount;
+    }
+    if (isInFlight)
+    {
+        if (ackedSequence.load(std::memory_order_acquire) == inFlightSequence)
+        {
+            isInFlight = false;
+            ackedState = inFlightState;
+            isAckedStateValid = true;
+            ++stats.ackedCount;
+        }
+        else if (resyncSequence.load(std::memory_order_acquire) == inFlightSequence)
+        {
+            isInFlight = false;
+            isAckedStateValid = false;
+        }
+        else
+        {
+            // Only the latest send's status matters, the flag is cleared either way
+            const bool isFailed = isSendFailed.exchange(false, std::memory_order_relaxed);
+            if (!isFailed && (uint32_t)(now_ms - lastTransmit_ms) < RADIO_ACK_TIMEOUT_MS)
+            {
+                return;
+            }
+            if (inFlightRetransmits == RADIO_MAX_RETRANSMITS)
+            {
+                // No telling what the hat has now, so the next packet is a full state
+                isInFlight = false;
+                isAckedStateValid = false;
+                isBackingOff = true;
+                ++stats.givenUpCount;
+            }
+            else
+            {
+                ++inFlightRetransmits;
+                ++stats.retransmitCount;
+                Transmit(now_ms);
+                return;
+            }
+        }
+    }
+
+    isSynced = isAckedStateValid && (ackedState == state);
+    if (isSynced)
+    {
+        return;
+    }
+    if (isBackingOff)
+    {
+        if ((uint32_t)(now_ms - lastTransmit_ms) < RADIO_RETRY_BACKOFF_MS)
+        {
+            return;
+        }
+        isBackingOff = false;
+    }
+    inFlightSequence = nextSequence;
+    nextSequence = (nextSequence == UINT16_MAX) ? 1 : nextSequence + 1;
+    inFlightState = state;
+    inFlightLength = EncodeState(inFlightPacket, state, isAckedStateValid ? &ackedState : NULL, session, inFlightSequence);
+    inFlightRetransmits = 0;
+    isInFlight = true;
+    awaitedSequence.store(inFlightSequence, std::memory_order_release);
+    isSendFailed.store(false, std::memory_order_relaxed);
+    ++stats.sentCount;
+    Transmit(now_ms);
+}
+
+void RadioSender::Transmit(uint32_t now_ms)
+{
+    lastTransmit_ms = now_ms;
+    if (!transport->Send(inFlightPacket, inFlightLength))
+    {
+        isSendFailed.store(true, std::memory_order_relaxed);
+    }
+}
+
+void RadioSender::OnReceive(const uint8_t *packet, int length)
+{
+    radioHeader_t header;
+    if (ReadHeader(packet, length, &header) != 0 || header.session != session)
+    {
+        return;
+    }
+    if (header.type == RadioPacketType::stale)
+    {
+        hatSequence.store(header.sequence, std::memory_order_release);
+        return;
+    }
+    if (header.sequence != awaitedSequence.load(std::memory_order_acquire))
+    {
+        return;
+    }
+    if (header.type == RadioPacketType::ack)
+    {
+        ackedSequence.store(header.sequence, std::memory_order_release);
+    }
+    else if (header.type == RadioPacketType::resync)
+    {
+        resyncSequence.store(header.sequence, std::memory_order_release);
+    }
+}
+
+void RadioSender::OnSendStatus(bool isDelivered)
+{
+    if (!isDelivered)
+    {
+        isSendFailed.store(true, std::memory_order_relaxed);
+    }
+}
+
+bool RadioSender::IsSynced() const
+{
+    return isSynced;
+}
+
+const radioSenderStats_t &RadioSender::Stats() const
+{
+    return stats;
+}
+
+//-------------- Receiver --------------
+
+RadioReceiver::RadioReceiver(RadioTransport *transport, const radioData_t &initialState)
+    : transport(transport),
+      currentState(initialState)
+{
+}
+
+bool RadioReceiver::OnReceive(const uint8_t *packet, int length, radioData_t *state)
+{
+    radioHeader_t header;
+    const int payloadLength = ReadHeader(packet, length, &header);
+    if (payloadLength < 0 || header.sequence == 0 ||
+        (header.type != RadioPacketType::full_state && header.type != RadioPacketType::delta_state))
+    {
+        ++stats.rejectedCount;
+        return false;
+    }
+    // A new session is a restarted controller, whatever its sequence numbers
+    if (!hasSession || header.session != currentSession)
+    {
+        hasSession = true;
+        hasState = false;
+        currentSession = header.session;
+        lastSequence = header.sequence - 1;
+    }
+    const int16_t sequenceAhead = (int16_t)(header.sequence - lastSequence);
+    if (sequenceAhead == 0)
+    {
+        // The ack was lost, the controller is still waiting for one
+        ++stats.duplicateCount;
+        Reply(RadioPacketType::ack, header.session, header.sequence);
+        return false;
+    }
+    if (sequenceAhead < 0)
+    {
+        ++stats.staleCount;
+        // Controllers always start with a full state, so tell one that may have restarted where
+        // this session's sequence is
+        if (header.type == RadioPacketType::full_state)
+        {
+            ++stats.staleReplyCount;
+            Reply(RadioPacketType::stale, header.session, lastSequence);
+        }
+        return false;
+    }
+    const bool isFullState = (header.type == RadioPacketType::full_state);
+    if (!isFullState && !hasState)
+    {
+        ++stats.resyncCount;
+        Reply(RadioPacketType::resync, header.session, header.sequence);
+        return false;
+    }
+    radioData_t newState = currentState;
+    if (!DecodeState(&packet[RADIO_HEADER_BYTES], payloadLength, isFullState, &newState))
+    {
+        ++stats.rejectedCount;
+        return false;
+    }
+    currentState = newState;
+    hasState = true;
+    lastSequence = header.sequence;
+    ++stats.appliedCount;
+    Reply(RadioPacketType::ack, header.session, header.sequence);
+    *state = currentState;
+    return true;
+}
+
+const radioReceiverStats_t &RadioReceiver::Stats() const
+{
+    return stats;
+}
+
+void RadioReceiver::Reply(RadioPacketType type, uint8_t session, uint16_t sequence)
+{
+    uint8_t packet[RADIO_HEADER_BYTES + RADIO_CRC_BYTES];
+    transport->Send(packet, AppendCrc(packet, WriteHeader(packet, type, session, sequence)));
+}
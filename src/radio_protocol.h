@@ -0,0 +1,146 @@
+#ifndef RADIO_PROTOCOL_H
+#define RADIO_PROTOCOL_H
+
+#include <atomic>
+#include <stdint.h>
+
+#include "interface.h"
+
+// Packed, versioned wire format for the controller state, with its own acks so the controller
+// knows what the hat is showing. Every packet is a 4 byte header, a payload and a CRC-8 of
+// everything before it, multi-byte fields are little endian:
+//   byte 0      RADIO_PROTOCOL_VERSION in the high nibble, RadioPacketType in the low nibble
+//   byte 1      session, picked by the controller at boot so its restarted sequence is not stale
+//   byte 2-3    sequence number, never 0
+// State packets carry one field byte, whose low nibble says which of effect, colour, brightness
+// and beat length follow in that order, and whose high bits are isEffectCommand and
+// ambientOverride. A full state has every field, a delta only those that changed since the state
+// the hat last acked. Acks and resync requests are a bare header echoing the packet answered,
+// a stale reply is a bare header carrying the hat's last applied sequence number instead.
+//
+// One state packet is in flight at a time. It is retransmitted when the link layer reports a
+// failed send or no ack comes within RADIO_ACK_TIMEOUT_MS, up to RADIO_MAX_RETRANSMITS times.
+
+#define RADIO_PROTOCOL_VERSION 1
+#define RADIO_MAX_PACKET_BYTES 11
+#define RADIO_ACK_TIMEOUT_MS 30
+#define RADIO_MAX_RETRANSMITS 5
+// After giving up on a packet wait this long before trying the full state again
+#define RADIO_RETRY_BACKOFF_MS 250
+
+enum class RadioPacketType : uint8_t
+{
+    full_state = 0,
+    delta_state = 1,
+    ack = 2,
+    // From the hat for a delta it has no state to apply to, such as after it restarted
+    resync = 3,
+    // From the hat for a full state older than its last, such as from a controller that
+    // restarted and happened to pick the same session. The controller skips past its sequence.
+    stale = 4,
+};
+
+// Whatever carries the packets, ESP-NOW on the devices or a lossy loopback on the host
+class RadioTransport
+{
+public:
+    virtual ~RadioTransport() = default;
+    // Returns false if the packet could not even be queued
+    virtual bool Send(const uint8_t *packet, uint8_t length) = 0;
+};
+
+typedef struct radioSenderStats_t
+{
+    uint32_t sentCount; // New state packets, not counting retransmits
+    uint32_t retransmitCount;
+    uint32_t ackedCount;
+    uint32_t givenUpCount;
+    uint32_t sequenceSkipCount; // Times the hat was found ahead of this session's sequence
+} radioSenderStats_s;
+
+// Controller end, keeps the hat in step with the controller's radioData
+class RadioSender
+{
+public:
+    RadioSender(RadioTransport *transport, uint8_t session);
+
+    // Send whatever the hat has not acked yet and retransmit on timeouts. Call often, always
+    // from the same task.
+    void Update(const radioData_t &state, uint32_t now_ms);
+
+    // For the transport's callbacks, which may run on another task
+    void OnReceive(const uint8_t *packet, int length);
+    void OnSendStatus(bool isDelivered);
+
+    // True once the hat has acked the latest state given to Update()
+    bool IsSynced() const;
+    const radioSenderStats_t &Stats() const;
+
+private:
+    void Transmit(uint32_t now_ms);
+
+    RadioTransport *const transport;
+    const uint8_t session;
+    uint16_t nextSequence = 1;
+
+    radioData_t ackedState = {};
+    bool isAckedStateValid = false;
+    bool isSynced = false;
+
+    bool isInFlight = false;
+    bool isBackingOff = false;
+    radioData_t inFlightState = {};
+    uint16_t inFlightSequence = 0;
+    uint8_t inFlightPacket[RADIO_MAX_PACKET_BYTES];
+    uint8_t inFlightLength = 0;
+    uint8_t inFlightRetransmits = 0;
+    uint32_t lastTransmit_ms = 0;
+
+    // Read by the callbacks, which only take answers to this packet so late duplicates of
+    // older answers are never mistaken for it
+    std::atomic<uint16_t> awaitedSequence{0};
+    // Written by the callbacks, 0 is never a sequence number
+    std::atomic<uint16_t> ackedSequence{0};
+    std::atomic<uint16_t> resyncSequence{0};
+    std::atomic<uint16_t> hatSequence{0};
+    std::atomic<bool> isSendFailed{false};
+
+    radioSenderStats_t stats = {};
+};
+
+typedef struct radioReceiverStats_t
+{
+    uint32_t appliedCount;
+    uint32_t duplicateCount; // Retransmits of a packet already applied, acked again
+    uint32_t staleCount;     // Older than the last applied, dropped
+    uint32_t rejectedCount;  // Wrong length, version or CRC
+    uint32_t resyncCount;
+    uint32_t staleReplyCount; // Stale full states answered with the hat's sequence number
+} radioReceiverStats_s;
+
+// Hat end, rebuilds the controller's radioData from the packets and acks them
+class RadioReceiver
+{
+public:
+    RadioReceiver(RadioTransport *transport, const radioData_t &initialState);
+
+    // Returns true with the new state if the packet is the next one from the controller.
+    // Replies through the transport before returning.
+    bool OnReceive(const uint8_t *packet, int length, radioData_t *state);
+
+    const radioReceiverStats_t &Stats() const;
+
+private:
+    void Reply(RadioPacketType type, uint8_t session, uint16_t sequence);
+
+    RadioTransport *const transport;
+    radioData_t currentState;
+    bool hasSession = false;
+    bool hasState = false;
+    uint8_t currentSession = 0;
+    uint16_t lastSequence = 0;
+
+    radioReceiverStats_t stats = {};
+};
+
+#endif // RADIO_PROTOCOL_H
@@ -0,0 +1,162 @@
+#include "real_fft.h"
+
+#include <math.h>
+
+#define COMPLEX_FFT_LENGTH (REAL_FFT_LENGTH / 2)
+
+static_assert((REAL_FFT_LENGTH & (REAL_FFT_LENGTH - 1)) == 0, "REAL_FFT_LENGTH must be a power of two");
+
+// cos(2 * pi * k / N) for k in [0, 3N/4), which also gives sin(2 * pi * k / N) = -cos(2 * pi * (k + N/4) / N)
+// for every twiddle index k in [0, N/2) used by the complex FFT and the split step
+static float cosineTable[3 * REAL_FFT_LENGTH / 4];
+// Hamming window is symmetric so only the first half is stored
+static float hammingTable[REAL_FFT_LENGTH / 2];
+
+static inline float TwiddleCos(uint32_t k)
+{
+    return cosineTable[k];
+}
+
+static inline float TwiddleSin(uint32_t k)
+{
+    return -cosineTable[k + REAL_FFT_LENGTH / 4];
+}
+
+static void ComplexFft(float *data);
+
+void RealFftInit()
+{
+    for (uint32_t k = 0; k < 3 * REAL_FFT_LENGTH / 4; ++k)
+    {
+        cosineTable[k] = cosf(2.0f * (float)M_PI * k / REAL_FFT_LENGTH);
+    }
+    for (uint32_t n = 0; n < REAL_FFT_LENGTH / 2; ++n)
+    {
+        hammingTable[n] = 0.54f - 0.46f * cosf(2.0f * (float)M_PI * n / (REAL_FFT_LENGTH - 1));
+    }
+}
+
+void RealFftLoadSamples(const int32_t sampleRing[REAL_FFT_LENGTH], uint32_t oldestIndex, int64_t sampleSum,
+                        float buffer[REAL_FFT_LENGTH])
+{
+    const float mean = (float)sampleSum / REAL_FFT_LENGTH;
+    for (uint32_t i = 0; i < REAL_FFT_LENGTH / 2; ++i)
+    {
+        const float window = hammingTable[i];
+        const uint32_t mirror = REAL_FFT_LENGTH - 1 - i;
+        buffer[i] = ((float)sampleRing[(oldestIndex + i) & (REAL_FFT_LENGTH - 1)] - mean) * window;
+        buffer[mirror] = ((float)sampleRing[(oldestIndex + mirror) & (REAL_FFT_LENGTH - 1)] - mean) * window;
+    }
+}
+
+void RealFftComputePower(float buffer[REAL_FFT_LENGTH])
+{
+    // buffer already holds z[n] = x[2n] + i * x[2n + 1] as interleaved re/im pairs
+    ComplexFft(buffer);
+
+    // Split Z = FFT(z) into the spectrum X of x. With Fe = (Z[k] + conj(Z[M-k])) / 2
+    // and Fo = -i * (Z[k] - conj(Z[M-k])) / 2: X[k] = Fe + W^k * Fo, X[M-k] = conj(Fe - W^k * Fo)
+    const float dc = buffer[0] + buffer[1];
+    const float nyquist = buffer[0] - buffer[1];
+    for (uint32_t k = 1; k < COMPLEX_FFT_LENGTH / 2; ++k)
+    {
+        float *zk = &buffer[2 * k];
+        float *zmk = &buffer[2 * (COMPLEX_FFT_LENGTH - k)];
+        const float evenRe = 0.5f * (zk[0] + zmk[0]);
+        const float evenIm = 0.5f * (zk[1] - zmk[1]);
+        const float oddRe = 0.5f * (zk[1] + zmk[1]);
+        const float oddIm = -0.5f * (zk[0] - zmk[0]);
+        const float wr = TwiddleCos(k);
+        const float wi = -TwiddleSin(k);
+        const float twiddledRe = wr * oddRe - wi * oddIm;
+        const float twiddledIm = wr * oddIm + wi * oddRe;
+        zk[0] = evenRe + twiddledRe;
+        zk[1] = evenIm + twiddledIm;
+        zmk[0] = evenRe - twiddledRe;
+        zmk[1] = -(evenIm - twiddledIm);
+    }
+    // X[M/2] = conj(Z[M/2]), which has the same power
+
+    // Power of bin k overwrites float k, which has always been read by then
+    buffer[0] = dc * dc;
+    for (uint32_t k = 1; k < COMPLEX_FFT_LENGTH; ++k)
+    {
+        const float re = buffer[2 * k];
+        const float im = buffer[2 * k + 1];
+        buffer[k] = re * re + im * im;
+    }
+    buffer[COMPLEX_FFT_LENGTH] = nyquist * nyquist;
+}
+
+float RealFftMajorPeak(const float power[REAL_FFT_BIN_COUNT], float samplingFrequency)
+{
+    // Power is monotonic in magnitude, so the peak search needs no square roots
+    float maxPower = 0;
+    uint32_t peakIndex = 0;
+    for (uint32_t i = 1; i < REAL_FFT_BIN_COUNT - 1; ++i)
+    {
+        if ((power[i - 1] < power[i]) && (power[i] > power[i + 1]) && (power[i] > maxPower))
+        {
+            maxPower = power[i];
+            peakIndex = i;
+        }
+    }
+    if (peakIndex == 0)
+    {
+        return 0;
+    }
+
+    // Parabolic interpolation over the magnitudes of the peak and its neighbours
+    const float before = sqrtf(power[peakIndex - 1]);
+    const float peak = sqrtf(power[peakIndex]);
+    const float after = sqrtf(power[peakIndex + 1]);
+    const float delta = 0.5f * ((before - after) / (before - (2.0f * peak) + after));
+    return ((peakIndex + delta) * samplingFrequency) / REAL_FFT_LENGTH;
+}
+
+// In-place radix 2 decimation in time FFT over COMPLEX_FFT_LENGTH interleaved complex values
+static void ComplexFft(float *data)
+{
+    for (uint32_t i = 0, j = 0; i < COMPLEX_FFT_LENGTH - 1; ++i)
+    {
+        if (i < j)
+        {
+            float re = data[2 * i];
+            float im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+        uint32_t bit = COMPLEX_FFT_LENGTH >> 1;
+        while (j & bit)
+        {
+            j ^= bit;
+            bit >>= 1;
+        }
+        j |= bit;
+    }
+
+    for (uint32_t length = 2; length <= COMPLEX_FFT_LENGTH; length <<= 1)
+    {
+        const uint32_t half = length >> 1;
+        // W_length^j == W_N^(j * N / length), N being the real length the tables are built for
+        const uint32_t twiddleStride = REAL_FFT_LENGTH / length;
+        for (uint32_t j = 0; j < half; ++j)
+        {
+            const float wr = TwiddleCos(j * twiddleStride);
+            const float wi = -TwiddleSin(j * twiddleStride);
+            for (uint32_t i = j; i < COMPLEX_FFT_LENGTH; i += length)
+            {
+                float *a = &data[2 * i];
+                float *b = &data[2 * (i + half)];
+                const float re = b[0] * wr - b[1] * wi;
+                const float im = b[0] * wi + b[1] * wr;
+                b[0] = a[0] - re;
+                b[1] = a[1] - im;
+                a[0] += re;
+                a[1] += im;
+            }
+        }
+    }
+}
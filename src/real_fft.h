@@ -0,0 +1,31 @@
+#ifndef REAL_FFT_H
+#define REAL_FFT_H
+
+#include <stdint.h>
+
+#include "beat_detection.h"
+
+// Forward FFT of FFT_BUFFER_LENGTH real samples, computed as an FFT_BUFFER_LENGTH / 2 point
+// complex FFT over the samples packed as interleaved (even, odd) pairs, plus a split step.
+// Twiddle and Hamming window tables are built once by RealFftInit().
+
+#define REAL_FFT_LENGTH FFT_BUFFER_LENGTH
+#define REAL_FFT_BIN_COUNT (REAL_FFT_LENGTH / 2 + 1)
+
+void RealFftInit();
+
+// Convert to float, remove DC and apply a Hamming window in one pass over the samples
+// @param sampleRing[in]     Ring of the latest REAL_FFT_LENGTH samples as read from the mic
+// @param oldestIndex[in]    Index of the oldest sample in sampleRing
+// @param sampleSum[in]      Sum of every sample in sampleRing, gives the DC offset
+// @param buffer[out]        REAL_FFT_LENGTH floats, ready for RealFftComputePower()
+void RealFftLoadSamples(const int32_t sampleRing[REAL_FFT_LENGTH], uint32_t oldestIndex, int64_t sampleSum,
+                        float buffer[REAL_FFT_LENGTH]);
+
+// Transform in place. On return buffer[0..REAL_FFT_BIN_COUNT) holds the power |X[k]|^2 of each bin.
+void RealFftComputePower(float buffer[REAL_FFT_LENGTH]);
+
+// Frequency of the strongest local peak, interpolated between bins like arduinoFFT's majorPeak()
+float RealFftMajorPeak(const float power[REAL_FFT_BIN_COUNT], float samplingFrequency);
+
+#endif // REAL_FFT_H
@@ -0,0 +1,188 @@
+#include "runtime_stats.h"
+
+#include <Arduino.h>
+
+#include "effects.h"
+#include "i2s_mic.h"
+#include "led_canvas.h"
+#include "timing.h"
+
+volatile uint32_t statsLoopCounts[(uint32_t)StatsLoop::loop_count];
+volatile uint32_t statsDroppedFrameCount = 0;
+
+#if defined(RUNTIME_STATS_ENABLED) && !defined(NATIVE_BUILD)
+#include <esp_freertos_hooks.h>
+
+#if !configUSE_TRACE_FACILITY
+#error "RUNTIME_STATS_ENABLED needs configUSE_TRACE_FACILITY for uxTaskGetSystemState()"
+#endif
+
+// Tasks reported, later ones are left out
+#define STATS_MAX_TASKS 24
+// Idle hook calls further apart than this had other work run in between, about 8 us at 240 MHz
+#define IDLE_HOOK_MAX_GAP_CYCLES 2000
+
+// The idle counters are 32 bit cycle counts, they must not wrap twice between reports
+static_assert(RUNTIME_STATS_PERIOD_MS < 10000, "RUNTIME_STATS_PERIOD_MS is too long for the idle cycle counters");
+
+static const char *const statsLoopNames[] = {"audio", "render"};
+static_assert(sizeof(statsLoopNames) / sizeof(statsLoopNames[0]) == (uint32_t)StatsLoop::loop_count, "Name every stats loop");
+
+typedef struct idleMeter_t
+{
+    uint32_t lastCallCycles;
+    uint32_t idleCycles; // Wraps, only differences are used
+} idleMeter_s;
+
+static volatile idleMeter_t idleMeters[portNUM_PROCESSORS];
+
+#if configGENERATE_RUN_TIME_STATS
+typedef struct taskRunTime_t
+{
+    TaskHandle_t handle;
+    uint32_t runTime;
+} taskRunTime_s;
+
+// Run-time counter of every task at the last report
+static taskRunTime_t lastRunTimes[STATS_MAX_TASKS];
+static UBaseType_t lastTaskCount = 0;
+
+static uint32_t LastTaskRunTime(TaskHandle_t handle);
+#endif
+
+static bool IdleHook();
+
+void RuntimeStatsInit()
+{
+    for (BaseType_t core = 0; core < portNUM_PROCESSORS; ++core)
+    {
+        esp_register_freertos_idle_hook_for_cpu(IdleHook, core);
+    }
+}
+
+void RuntimeStatsReport()
+{
+    static TaskStatus_t taskStates[STATS_MAX_TASKS];
+    static int64_t lastReportTime_us = 0;
+    static uint32_t lastIdleCycles[portNUM_PROCESSORS];
+    static uint32_t lastLoopCounts[(uint32_t)StatsLoop::loop_count];
+    static uint32_t lastSkippedFrames = 0;
+    static uint32_t lastDroppedFrames = 0;
+    static uint32_t lastUnchangedFrames = 0;
+    static uint32_t lastFadeSkippedLeds = 0;
+
+    // Sample everything first so the printing below does not skew the numbers
+    const uint32_t startCycles = GetCycleCount();
+    const int64_t now_us = GetMicros();
+    const float elapsed_us = (float)(now_us - lastReportTime_us);
+    uint32_t idleCycles[portNUM_PROCESSORS];
+    for (uint32_t core = 0; core < portNUM_PROCESSORS; ++core)
+    {
+        idleCycles[core] = idleMeters[core].idleCycles;
+    }
+    uint32_t loopCounts[(uint32_t)StatsLoop::loop_count];
+    for (uint32_t loop = 0; loop < (uint32_t)StatsLoop::loop_count; ++loop)
+    {
+        loopCounts[loop] = statsLoopCounts[loop];
+    }
+    const uint32_t skippedFrames = SkippedFrameCount();
+    const uint32_t droppedFrames = statsDroppedFrameCount;
+    const uint32_t unchangedFrames = UnchangedFrameCount();
+    const uint32_t fadeSkippedLeds = FadeSkippedLedCount();
+    micStats_t micStats;
+    GetMicStats(&micStats);
+    const UBaseType_t taskCount = uxTaskGetSystemState(taskStates, STATS_MAX_TASKS, NULL);
+    const uint32_t freeHeap = ESP.getFreeHeap();
+    const uint32_t minFreeHeap = ESP.getMinFreeHeap();
+    const uint32_t sampleCycles = GetCycleCount() - startCycles;
+
+    if (lastReportTime_us != 0)
+    {
+        Serial.printf("\nStats over %.0f ms, sampled in %u us\n", elapsed_us / 1000, sampleCycles / GetCyclesPerMicro());
+        for (uint32_t core = 0; core < portNUM_PROCESSORS; ++core)
+        {
+            const float idle_us = (float)(idleCycles[core] - lastIdleCycles[core]) / GetCyclesPerMicro();
+            Serial.printf("core %u load %5.1f%%\n", core, 100 * (1 - idle_us / elapsed_us));
+        }
+        for (uint32_t loop = 0; loop < (uint32_t)StatsLoop::loop_count; ++loop)
+        {
+            Serial.printf("%s loop %.1f/s\n", statsLoopNames[loop], (loopCounts[loop] - lastLoopCounts[loop]) * 1e6f / elapsed_us);
+        }
+        Serial.printf("%u frames skipped while the last was still being sent\n", skippedFrames - lastSkippedFrames);
+        Serial.printf("%u frames dropped by rendering running late\n", droppedFrames - lastDroppedFrames);
+        Serial.printf("%u unchanged frames not sent, %u black LEDs not faded\n", unchangedFrames - lastUnchangedFrames,
+                      fadeSkippedLeds - lastFadeSkippedLeds);
+        Serial.printf("mic %u overruns, %u samples dropped, %u short reads, latency %u us mean %u us max\n",
+                      micStats.overrunCount, micStats.droppedSampleCount, micStats.shortReadCount,
+                      micStats.meanLatency_us, micStats.maxLatency_us);
+        Serial.printf("heap %u free, %u min free\n", freeHeap, minFreeHeap);
+        Serial.printf("%-16s %4s %4s %6s %10s\n", "task", "core", "prio", "cpu", "stack free");
+        for (UBaseType_t i = 0; i < taskCount; ++i)
+        {
+            const TaskStatus_t *task = &taskStates[i];
+#if configTASKLIST_INCLUDE_COREID
+            // Unpinned tasks report a core id past the last core
+            const int core = (task->xCoreID < portNUM_PROCESSORS) ? (int)task->xCoreID : -1;
+#else
+            const int core = -1;
+#endif
+#if configGENERATE_RUN_TIME_STATS
+            // Run-time counters tick in us, so this is the share of one core
+            const float cpu = 100 * (task->ulRunTimeCounter - LastTaskRunTime(task->xHandle)) / elapsed_us;
+            Serial.printf("%-16s %4d %4u %5.1f%% %10u\n", task->pcTaskName, core, task->uxCurrentPriority, cpu,
+                          task->usStackHighWaterMark);
+#else
+            Serial.printf("%-16s %4d %4u %6s %10u\n", task->pcTaskName, core, task->uxCurrentPriority, "-",
+                          task->usStackHighWaterMark);
+#endif
+        }
+    }
+
+#if configGENERATE_RUN_TIME_STATS
+    for (UBaseType_t i = 0; i < taskCount; ++i)
+    {
+        lastRunTimes[i].handle = taskStates[i].xHandle;
+        lastRunTimes[i].runTime = taskStates[i].ulRunTimeCounter;
+    }
+    lastTaskCount = taskCount;
+#endif
+    lastReportTime_us = now_us;
+    lastSkippedFrames = skippedFrames;
+    lastDroppedFrames = droppedFrames;
+    lastUnchangedFrames = unchangedFrames;
+    lastFadeSkippedLeds = fadeSkippedLeds;
+    memcpy(lastIdleCycles, idleCycles, sizeof(lastIdleCycles));
+    memcpy(lastLoopCounts, loopCounts, sizeof(lastLoopCounts));
+}
+
+#if configGENERATE_RUN_TIME_STATS
+// Run-time counter of a task at the last report, 0 for a task created since
+static uint32_t LastTaskRunTime(TaskHandle_t handle)
+{
+    for (UBaseType_t i = 0; i < lastTaskCount; ++i)
+    {
+        if (lastRunTimes[i].handle == handle)
+        {
+            return lastRunTimes[i].runTime;
+        }
+    }
+    return 0;
+}
+#endif
+
+// Runs back to back in each core's idle task, adding up the cycles between calls that were
+// not interrupted by other work. Returning false has the idle task call it again straight away
+// rather than waiting for an interrupt, so this costs power but no time from other tasks.
+static bool IdleHook()
+{
+    volatile idleMeter_t *meter = &idleMeters[GetCoreId()];
+    const uint32_t now = GetCycleCount();
+    const uint32_t gap = now - meter->lastCallCycles;
+    if (gap < IDLE_HOOK_MAX_GAP_CYCLES)
+    {
+        meter->idleCycles += gap;
+    }
+    meter->lastCallCycles = now;
+    return false;
+}
+#endif // RUNTIME_STATS_ENABLED
@@ -0,0 +1,44 @@
+#ifndef RUNTIME_STATS_H
+#define RUNTIME_STATS_H
+
+#include <stdint.h>
+
+#include "profiling.h"
+
+// CPU headroom of the hat, enabled with RUNTIME_STATS_ENABLED in profiling.h. Core load comes
+// from idle hooks that count the cycles each core spends idle, per task CPU from the FreeRTOS
+// run-time counters, and stack headroom from each task's high-water mark. Device only.
+
+enum class StatsLoop : uint8_t
+{
+    audio,
+    render,
+    loop_count,
+};
+
+#if defined(RUNTIME_STATS_ENABLED) && !defined(NATIVE_BUILD)
+#define STATS_COUNT_LOOP(loop) RuntimeStatsCountLoop(loop)
+#define STATS_COUNT_DROPPED_FRAMES(count) (statsDroppedFrameCount += (count))
+#else
+#define STATS_COUNT_LOOP(loop) do { } while(0)
+#define STATS_COUNT_DROPPED_FRAMES(count) do { } while(0)
+#endif // RUNTIME_STATS_ENABLED
+
+// Iterations of each loop, each only ever incremented by the one task running that loop
+extern volatile uint32_t statsLoopCounts[(uint32_t)StatsLoop::loop_count];
+// Frame slots the render task ran past without rendering, incremented by that task only
+extern volatile uint32_t statsDroppedFrameCount;
+
+inline void RuntimeStatsCountLoop(StatsLoop loop)
+{
+    statsLoopCounts[(uint32_t)loop]++;
+}
+
+// Register the idle hooks, call from setup() before creating the tasks
+void RuntimeStatsInit();
+
+// Sample every counter and print the changes since the last call. Call from a low priority
+// task every RUNTIME_STATS_PERIOD_MS, the sampling is a few tens of us, the printing is not.
+void RuntimeStatsReport();
+
+#endif // RUNTIME_STATS_H
@@ -0,0 +1,110 @@
+#include "sliding_dft.h"
+
+#include <math.h>
+
+// Energy is tracked on the 24 bits the mic actually delivers, so it fits in an int64
+#define ENERGY_SAMPLE_SHIFT 8
+
+// Unwindowed bins with the phase referenced to the oldest sample in the window
+static float binRe[SLIDING_DFT_BIN_COUNT];
+static float binIm[SLIDING_DFT_BIN_COUNT];
+// e^(j * 2 * pi * k / N), the rotation each bin takes per sample
+static float rotationRe[SLIDING_DFT_BIN_COUNT];
+static float rotationIm[SLIDING_DFT_BIN_COUNT];
+
+// Running sums for the energy in the window, kept in integers so they never drift. Taking out
+// the DC is done in float, sum squared would overflow an int64.
+static int64_t windowSum = 0;
+static int64_t windowSumOfSquares = 0;
+
+void SlidingDftInit()
+{
+    for (uint32_t i = 0; i < SLIDING_DFT_BIN_COUNT; ++i)
+    {
+        const uint32_t bin = i + 1;
+        rotationRe[i] = cosf(2.0f * (float)M_PI * bin / FFT_BUFFER_LENGTH);
+        rotationIm[i] = sinf(2.0f * (float)M_PI * bin / FFT_BUFFER_LENGTH);
+        binRe[i] = 0;
+        binIm[i] = 0;
+    }
+    windowSum = 0;
+    windowSumOfSquares = 0;
+}
+
+void SlidingDftUpdate(const int32_t *newSamples, const int32_t *oldSamples, uint32_t count)
+{
+    for (uint32_t n = 0; n < count; ++n)
+    {
+        const float delta = (float)newSamples[n] - (float)oldSamples[n];
+        // X_k <- (X_k + x_new - x_old) * e^(j * 2 * pi * k / N)
+        for (uint32_t i = 0; i < SLIDING_DFT_BIN_COUNT; ++i)
+        {
+            const float re = binRe[i] + delta;
+            const float im = binIm[i];
+            binRe[i] = re * rotationRe[i] - im * rotationIm[i];
+            binIm[i] = re * rotationIm[i] + im * rotationRe[i];
+        }
+
+        const int64_t newValue = newSamples[n] >> ENERGY_SAMPLE_SHIFT;
+        const int64_t oldValue = oldSamples[n] >> ENERGY_SAMPLE_SHIFT;
+        windowSum += newValue - oldValue;
+        windowSumOfSquares += newValue * newValue - oldValue * oldValue;
+    }
+}
+
+void SlidingDftResync(const int32_t window[FFT_BUFFER_LENGTH])
+{
+    for (uint32_t i = 0; i < SLIDING_DFT_BIN_COUNT; ++i)
+    {
+        // Phasor steps by e^(-j * 2 * pi * k / N), drift over one window is far below float noise
+        float phasorRe = 1.0f;
+        float phasorIm = 0.0f;
+        float re = 0;
+        float im = 0;
+        for (uint32_t m = 0; m < FFT_BUFFER_LENGTH; ++m)
+        {
+            const float sample = (float)window[m];
+            re += sample * phasorRe;
+            im += sample * phasorIm;
+            const float nextRe = phasorRe * rotationRe[i] + phasorIm * rotationIm[i];
+            phasorIm = phasorIm * rotationRe[i] - phasorRe * rotationIm[i];
+            phasorRe = nextRe;
+        }
+        binRe[i] = re;
+        binIm[i] = im;
+    }
+}
+
+void SlidingDftComputePower(float binPower[SLIDING_DFT_LAST_BIN])
+{
+    // The Hamming window 0.54 - 0.46 * cos(2 * pi * n / N) in the frequency domain is
+    // 0.54 * X[k] - 0.23 * (X[k - 1] + X[k + 1]). DC removal makes X[0] zero.
+    binPower[0] = 0;
+    for (uint32_t bin = 1; bin < SLIDING_DFT_LAST_BIN; ++bin)
+    {
+        const uint32_t i = bin - 1;
+        const float belowRe = (bin > 1) ? binRe[i - 1] : 0.0f;
+        const float belowIm = (bin > 1) ? binIm[i - 1] : 0.0f;
+        const float re = 0.54f * binRe[i] - 0.23f * (belowRe + binRe[i + 1]);
+        const float im = 0.54f * binIm[i] - 0.23f * (belowIm + binIm[i + 1]);
+        binPower[bin] = re * re + im * im;
+    }
+}
+
+float SlidingDftEnergyFraction(uint32_t lastBin)
+{
+    // Parseval: the N bins hold N times the energy of the samples, bins k and N - k hold the same
+    float binEnergy = 0;
+    for (uint32_t i = 0; i < lastBin && i < SLIDING_DFT_BIN_COUNT; ++i)
+    {
+        binEnergy += 2.0f * (binRe[i] * binRe[i] + binIm[i] * binIm[i]);
+    }
+    const float sum = (float)windowSum;
+    const float scaledEnergy = (float)windowSumOfSquares - sum * sum / FFT_BUFFER_LENGTH;
+    const float energy = scaledEnergy * (float)(1u << (2 * ENERGY_SAMPLE_SHIFT)) * FFT_BUFFER_LENGTH;
+    if (energy <= 0)
+    {
+        return 0;
+    }
+    return binEnergy / energy;
+}
@@ -0,0 +1,33 @@
+#ifndef SLIDING_DFT_H
+#define SLIDING_DFT_H
+
+#include <stdint.h>
+
+#include "beat_detection.h"
+
+// Sliding DFT over the latest FFT_BUFFER_LENGTH samples for a handful of low bins only.
+// Each sample costs one complex multiply per tracked bin, no matter the hop length.
+// Tracks bins 1 to SLIDING_DFT_LAST_BIN; Hamming windowed power is available for bins
+// 1 to SLIDING_DFT_LAST_BIN - 1, as the window mixes in the bins either side.
+
+#define SLIDING_DFT_LAST_BIN (MID_BAND_UPPER_BIN + 1)
+#define SLIDING_DFT_BIN_COUNT SLIDING_DFT_LAST_BIN
+
+void SlidingDftInit();
+
+// Slide the window along by count samples
+// @param newSamples[in]    Samples entering the window, oldest first
+// @param oldSamples[in]    The samples they replace, leaving the window
+void SlidingDftUpdate(const int32_t *newSamples, const int32_t *oldSamples, uint32_t count);
+
+// Recompute the bins directly to clear accumulated rounding error
+// @param window[in]    FFT_BUFFER_LENGTH samples currently in the window, oldest first
+void SlidingDftResync(const int32_t window[FFT_BUFFER_LENGTH]);
+
+// Write the Hamming windowed, DC removed power of bins 1 to SLIDING_DFT_LAST_BIN - 1 into binPower
+void SlidingDftComputePower(float binPower[SLIDING_DFT_LAST_BIN]);
+
+// Share of the DC removed energy in the window held by bins 1 to lastBin, 0 to 1
+float SlidingDftEnergyFraction(uint32_t lastBin);
+
+#endif // SLIDING_DFT_H
@@ -0,0 +1,121 @@
+#include "spectral_flux.h"
+
+#include <math.h>
+#include <string.h>
+
+// Added to every bin's power before the log, so the flux of near silence stays small
+#define SPECTRAL_FLUX_POWER_FLOOR 1e16f
+#define SPECTRAL_FLUX_THRESHOLD_COEFF 2.5f
+// Average flux, in log2 units, below which nothing counts as an onset
+#define SPECTRAL_FLUX_MIN_AVERAGE 0.05f
+// Frames are compared with the one a whole window earlier, overlapping frames share too much to differ
+#define SPECTRAL_FLUX_FRAME_LAG (FFT_BUFFER_LENGTH / ANALYSIS_HOP_LENGTH)
+
+static_assert(SPECTRAL_FLUX_FIRST_BIN + SPECTRAL_FLUX_BIN_COUNT <= FFT_BUFFER_LENGTH / 2 + 1, "Spectral flux bins past Nyquist");
+
+// Log power of the last SPECTRAL_FLUX_FRAME_LAG frames, oldest at logPowerIndex, and the rise
+// of each bin since the oldest. Both start at SPECTRAL_FLUX_FIRST_BIN.
+static float logPowerHistory[SPECTRAL_FLUX_FRAME_LAG][SPECTRAL_FLUX_BIN_COUNT];
+static uint32_t logPowerIndex = 0;
+static float binRise[SPECTRAL_FLUX_BIN_COUNT];
+
+// Band b covers binRise[bandStart[b]] up to binRise[bandStart[b + 1]]
+static uint32_t bandStart[SPECTRAL_FLUX_MAX_BAND_COUNT + 1];
+static uint32_t bandCount = 0;
+
+static float flux = 0;
+static float averageFlux = 0;
+static float fluxLeakyAverageCoeff = 0;
+
+static void LogPowerRise(const float *__restrict power, float *__restrict previousLogPower, float *__restrict rise);
+static inline float FastLog2(float value);
+
+void SpectralFluxInit(float leakyAverageCoeff)
+{
+    // Log spaced edges from SPECTRAL_FLUX_MIN_HZ to SPECTRAL_FLUX_MAX_HZ, at least one bin per band.
+    // Low bands are narrower than a bin, so there may be fewer than SPECTRAL_FLUX_MAX_BAND_COUNT.
+    const uint32_t binsInRange = SPECTRAL_FLUX_LAST_BIN - SPECTRAL_FLUX_FIRST_BIN + 1;
+    const float bandRatio = powf(SPECTRAL_FLUX_MAX_HZ / SPECTRAL_FLUX_MIN_HZ, 1.0f / SPECTRAL_FLUX_MAX_BAND_COUNT);
+    bandCount = 0;
+    bandStart[0] = 0;
+    float edge_hz = SPECTRAL_FLUX_MIN_HZ;
+    for (uint32_t band = 0; band < SPECTRAL_FLUX_MAX_BAND_COUNT; ++band)
+    {
+        edge_hz *= bandRatio;
+        uint32_t end = ANALYSIS_BIN(edge_hz) - SPECTRAL_FLUX_FIRST_BIN;
+        if (end > binsInRange)
+        {
+            end = binsInRange;
+        }
+        if (end > bandStart[bandCount])
+        {
+            bandStart[++bandCount] = end;
+        }
+    }
+    if (bandStart[bandCount] < binsInRange)
+    {
+        bandStart[++bandCount] = binsInRange;
+    }
+
+    for (uint32_t i = 0; i < SPECTRAL_FLUX_BIN_COUNT; ++i)
+    {
+        for (uint32_t frame = 0; frame < SPECTRAL_FLUX_FRAME_LAG; ++frame)
+        {
+            logPowerHistory[frame][i] = FastLog2(SPECTRAL_FLUX_POWER_FLOOR);
+        }
+        binRise[i] = 0;
+    }
+    logPowerIndex = 0;
+    flux = 0;
+    averageFlux = 0;
+    fluxLeakyAverageCoeff = leakyAverageCoeff;
+}
+
+float SpectralFluxUpdate(const float *power)
+{
+    // The oldest frame is replaced by this one as it is compared
+    LogPowerRise(&power[SPECTRAL_FLUX_FIRST_BIN], logPowerHistory[logPowerIndex], binRise);
+    logPowerIndex = (logPowerIndex + 1) % SPECTRAL_FLUX_FRAME_LAG;
+
+    // Each band's mean rise counts equally
+    float bandRiseSum = 0;
+    for (uint32_t band = 0; band < bandCount; ++band)
+    {
+        float sum = 0;
+        for (uint32_t i = bandStart[band]; i < bandStart[band + 1]; ++i)
+        {
+            sum += binRise[i];
+        }
+        bandRiseSum += sum / (bandStart[band + 1] - bandStart[band]);
+    }
+    flux = bandRiseSum / bandCount;
+    averageFlux += (flux - averageFlux) * fluxLeakyAverageCoeff;
+    return flux;
+}
+
+bool SpectralFluxIsOnset(float *strength)
+{
+    *strength = (averageFlux > 0) ? flux / averageFlux : 0;
+    return (averageFlux > SPECTRAL_FLUX_MIN_AVERAGE) && (flux > averageFlux * SPECTRAL_FLUX_THRESHOLD_COEFF);
+}
+
+// Half wave rectified rise in log power of every bin since an earlier frame, which is then overwritten
+static void LogPowerRise(const float *__restrict power, float *__restrict previousLogPower, float *__restrict rise)
+{
+    for (uint32_t i = 0; i < SPECTRAL_FLUX_BIN_COUNT; ++i)
+    {
+        const float logPower = FastLog2(power[i] + SPECTRAL_FLUX_POWER_FLOOR);
+        const float difference = logPower - previousLogPower[i];
+        rise[i] = (difference > 0) ? difference : 0;
+        previousLogPower[i] = logPower;
+    }
+}
+
+// log2 from the float's exponent and mantissa bits, within 0.09 of the real thing.
+// Integer and convert only, so it vectorizes where logf() would not.
+static inline float FastLog2(float value)
+{
+    int32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits * (1.0f / (1 << 23)) - 127.0f;
+}
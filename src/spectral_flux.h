@@ -0,0 +1,36 @@
+#ifndef SPECTRAL_FLUX_H
+#define SPECTRAL_FLUX_H
+
+#include <stdint.h>
+
+#include "beat_detection.h"
+
+// Onset detector from the rise in log power between frames, averaged over log spaced bands so
+// the bass is not outvoted by the many bins above it. An onset is a frame whose flux is far enough
+// above its leaky average.
+//
+// The per bin loops run over a fixed, multiple of 8 count of contiguous floats with no branches,
+// which lets the compiler vectorize them.
+
+#define SPECTRAL_FLUX_MIN_HZ 40.0f
+#define SPECTRAL_FLUX_MAX_HZ 5000.0f
+#define SPECTRAL_FLUX_MAX_BAND_COUNT 24
+
+#define SPECTRAL_FLUX_FIRST_BIN ANALYSIS_BIN(SPECTRAL_FLUX_MIN_HZ)
+#define SPECTRAL_FLUX_LAST_BIN                                                                   \
+    ((ANALYSIS_BIN(SPECTRAL_FLUX_MAX_HZ) < FFT_BUFFER_LENGTH / 2 - 8) ? ANALYSIS_BIN(SPECTRAL_FLUX_MAX_HZ) \
+                                                                       : FFT_BUFFER_LENGTH / 2 - 8)
+#define SPECTRAL_FLUX_BIN_COUNT (((SPECTRAL_FLUX_LAST_BIN - SPECTRAL_FLUX_FIRST_BIN + 1) + 7) & ~7)
+
+// @param leakyAverageCoeff[in]    Weight of each frame in the flux average
+void SpectralFluxInit(float leakyAverageCoeff);
+
+// Add the next frame and return its flux
+// @param power[in]    Power of each bin, as left by RealFftComputePower()
+float SpectralFluxUpdate(const float *power);
+
+// True if the latest frame's flux is an onset
+// @param strength[out]    Flux of the latest frame over its average
+bool SpectralFluxIsOnset(float *strength);
+
+#endif // SPECTRAL_FLUX_H
@@ -0,0 +1,55 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <stdint.h>
+
+// Lock-free ring buffer for handing items from one task to another.
+// Exactly one task may Push and exactly one other task may Pop, neither ever blocks.
+// CAPACITY must be a power of two so the free running indices wrap cleanly.
+template <typename T, uint32_t CAPACITY>
+class SpscRing
+{
+    static_assert(CAPACITY != 0 && (CAPACITY & (CAPACITY - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+    // Producer only. Returns false and counts a drop if the consumer has fallen behind.
+    bool Push(const T &item)
+    {
+        const uint32_t head = headIndex.load(std::memory_order_relaxed);
+        if (head - tailIndex.load(std::memory_order_acquire) == CAPACITY)
+        {
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        items[head & (CAPACITY - 1)] = item;
+        headIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. Returns false if there is nothing to pop.
+    bool Pop(T *item)
+    {
+        const uint32_t tail = tailIndex.load(std::memory_order_relaxed);
+        if (tail == headIndex.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        *item = items[tail & (CAPACITY - 1)];
+        tailIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    uint32_t DroppedCount() const
+    {
+        return droppedCount.load(std::memory_order_relaxed);
+    }
+
+private:
+    T items[CAPACITY];
+    std::atomic<uint32_t> headIndex{0};
+    std::atomic<uint32_t> tailIndex{0};
+    std::atomic<uint32_t> droppedCount{0};
+};
+
+#endif // SPSC_RING_H
@@ -0,0 +1,183 @@
+#include "tempo_tracker.h"
+
+#include <math.h>
+
+// Hops between tempo updates, the phase is updated every hop
+#define TEMPO_UPDATE_HOPS 32
+// Spread of the weighting towards the prior beat length, one octave halves the tempo
+#define TEMPO_PRIOR_WIDTH_OCTAVES 1.0f
+// Beats of onset history the phase is fitted to
+#define TEMPO_PHASE_BEATS 4
+// How long after a beat its onset strength peaks, from the window and the rise of the kick
+#define TEMPO_ONSET_DELAY_MS 8.0f
+
+#define TEMPO_MIN_LAG ((uint32_t)(60000 / (TEMPO_MAX_BPM * TEMPO_HOP_PERIOD_MS)))
+#define TEMPO_MAX_LAG ((uint32_t)(60000 / (TEMPO_MIN_BPM * TEMPO_HOP_PERIOD_MS)) + 1)
+
+static_assert(TEMPO_PHASE_BEATS * (TEMPO_MAX_LAG + 1) < TEMPO_HISTORY_LENGTH, "Onset history too short to fit the phase");
+
+// Onset strength of every hop, newest just before historyIndex
+static float onsetHistory[TEMPO_HISTORY_LENGTH];
+static uint32_t historyIndex = 0;
+static uint32_t hopsSinceTempoUpdate = 0;
+
+// Beat length in hops, 0 until the onsets have shown a tempo
+static float beatPeriod_hops = 0;
+static float tempoConfidence = 0;
+
+static void UpdateTempo(uint16_t priorBeatLength_ms);
+static float Autocorrelation(const float *onsets, uint32_t lag);
+static uint32_t HopsSinceLastBeat();
+static inline float OnsetHopsAgo(uint32_t hopsAgo);
+
+void TempoTrackerInit()
+{
+    for (uint32_t i = 0; i < TEMPO_HISTORY_LENGTH; ++i)
+    {
+        onsetHistory[i] = 0;
+    }
+    historyIndex = 0;
+    hopsSinceTempoUpdate = 0;
+    beatPeriod_hops = 0;
+    tempoConfidence = 0;
+}
+
+void TempoTrackerUpdate(float onsetStrength, int64_t time_ms, uint16_t priorBeatLength_ms, tempoEstimate_t *estimate)
+{
+    onsetHistory[historyIndex] = onsetStrength;
+    historyIndex = (historyIndex + 1) % TEMPO_HISTORY_LENGTH;
+
+    if (++hopsSinceTempoUpdate >= TEMPO_UPDATE_HOPS)
+    {
+        hopsSinceTempoUpdate = 0;
+        UpdateTempo(priorBeatLength_ms);
+    }
+
+    if (beatPeriod_hops == 0)
+    {
+        estimate->bpm = 0;
+        estimate->confidence = 0;
+        estimate->nextBeatTime_ms = 0;
+        return;
+    }
+
+    // Only the offsets from time_ms are float, a float time since boot would lose whole
+    // milliseconds after a few hours up
+    const float beatPeriod_ms = beatPeriod_hops * TEMPO_HOP_PERIOD_MS;
+    const float lastBeatOffset_ms = -(HopsSinceLastBeat() * TEMPO_HOP_PERIOD_MS) - TEMPO_ONSET_DELAY_MS;
+    float nextBeatOffset_ms = lastBeatOffset_ms + beatPeriod_ms;
+    while (nextBeatOffset_ms <= 0)
+    {
+        nextBeatOffset_ms += beatPeriod_ms;
+    }
+    estimate->bpm = 60000 / beatPeriod_ms;
+    estimate->confidence = tempoConfidence;
+    estimate->nextBeatTime_ms = time_ms + (int64_t)(nextBeatOffset_ms + 0.5f);
+}
+
+// Pick the beat length from the strongest autocorrelation peak of the onset history
+static void UpdateTempo(uint16_t priorBeatLength_ms)
+{
+    // Oldest first with the mean removed, so a steady stream of onsets doesn't look periodic at every lag
+    static float onsets[TEMPO_HISTORY_LENGTH];
+    float mean = 0;
+    for (uint32_t i = 0; i < TEMPO_HISTORY_LENGTH; ++i)
+    {
+        mean += onsetHistory[i];
+    }
+    mean /= TEMPO_HISTORY_LENGTH;
+    for (uint32_t i = 0; i < TEMPO_HISTORY_LENGTH; ++i)
+    {
+        onsets[i] = onsetHistory[(historyIndex + i) % TEMPO_HISTORY_LENGTH] - mean;
+    }
+
+    const float energy = Autocorrelation(onsets, 0);
+    if (energy <= 0)
+    {
+        beatPeriod_hops = 0;
+        tempoConfidence = 0;
+        return;
+    }
+
+    // One lag either side of the range for the peak test and interpolation
+    float autocorrelation[TEMPO_MAX_LAG + 2];
+    for (uint32_t lag = TEMPO_MIN_LAG - 1; lag <= TEMPO_MAX_LAG + 1; ++lag)
+    {
+        autocorrelation[lag] = Autocorrelation(onsets, lag);
+    }
+
+    const float priorLag = priorBeatLength_ms / TEMPO_HOP_PERIOD_MS;
+    uint32_t bestLag = 0;
+    float bestScore = 0;
+    for (uint32_t lag = TEMPO_MIN_LAG; lag <= TEMPO_MAX_LAG; ++lag)
+    {
+        const bool isPeak = (autocorrelation[lag] >= autocorrelation[lag - 1]) && (autocorrelation[lag] >= autocorrelation[lag + 1]);
+        if (!isPeak)
+        {
+            continue;
+        }
+        float score = autocorrelation[lag];
+        if (priorLag > 0)
+        {
+            const float octaves = log2f(lag / priorLag) / TEMPO_PRIOR_WIDTH_OCTAVES;
+            score *= expf(-0.5f * octaves * octaves);
+        }
+        if (score > bestScore)
+        {
+            bestScore = score;
+            bestLag = lag;
+        }
+    }
+    if (bestLag == 0)
+    {
+        beatPeriod_hops = 0;
+        tempoConfidence = 0;
+        return;
+    }
+
+    // Parabolic interpolation between the neighbouring lags for a fractional beat length
+    const float before = autocorrelation[bestLag - 1];
+    const float peak = autocorrelation[bestLag];
+    const float after = autocorrelation[bestLag + 1];
+    const float curvature = before - 2 * peak + after;
+    const float offset = (curvature < 0) ? 0.5f * (before - after) / curvature : 0;
+    beatPeriod_hops = bestLag + offset;
+    tempoConfidence = fminf(fmaxf(peak / energy, 0), 1);
+}
+
+static float Autocorrelation(const float *onsets, uint32_t lag)
+{
+    float sum = 0;
+    for (uint32_t i = lag; i < TEMPO_HISTORY_LENGTH; ++i)
+    {
+        sum += onsets[i] * onsets[i - lag];
+    }
+    return sum / (TEMPO_HISTORY_LENGTH - lag);
+}
+
+// Offset of the pulse train at the current tempo that collects the most onset strength
+// over the last TEMPO_PHASE_BEATS beats
+static uint32_t HopsSinceLastBeat()
+{
+    uint32_t bestPhase = 0;
+    float bestSum = -1;
+    for (uint32_t phase = 0; phase < (uint32_t)ceilf(beatPeriod_hops); ++phase)
+    {
+        float sum = 0;
+        for (uint32_t beat = 0; beat < TEMPO_PHASE_BEATS; ++beat)
+        {
+            sum += OnsetHopsAgo(phase + (uint32_t)(beat * beatPeriod_hops + 0.5f));
+        }
+        if (sum > bestSum)
+        {
+            bestSum = sum;
+            bestPhase = phase;
+        }
+    }
+    return bestPhase;
+}
+
+static inline float OnsetHopsAgo(uint32_t hopsAgo)
+{
+    return onsetHistory[(historyIndex + TEMPO_HISTORY_LENGTH - 1 - hopsAgo) % TEMPO_HISTORY_LENGTH];
+}
@@ -0,0 +1,34 @@
+#ifndef TEMPO_TRACKER_H
+#define TEMPO_TRACKER_H
+
+#include <stdint.h>
+
+#include "beat_detection.h"
+
+// Tempo and beat phase from the onset strength of every hop. The tempo is the autocorrelation
+// peak of the onset history, weighted towards the controller's beat length, and the phase is
+// the offset of the pulse train at that tempo that best lines up with the same history.
+
+#define TEMPO_HOP_PERIOD_MS ((float)FFT_HOP_LENGTH * 1000 / SAMPLING_FREQUENCY_HZ)
+// Onset strengths kept, 768 hops is about 4 s at the default hop
+#define TEMPO_HISTORY_LENGTH 768
+#define TEMPO_MIN_BPM 70
+#define TEMPO_MAX_BPM 180
+
+typedef struct tempoEstimate_t
+{
+    float bpm;
+    float confidence; // 0 to 1, how periodic the onsets are at bpm
+    int64_t nextBeatTime_ms;
+} tempoEstimate_s;
+
+void TempoTrackerInit();
+
+// Add the onset strength of the latest hop and refresh the estimate
+// @param onsetStrength[in]         Rise in bass energy over the hop, 0 if it fell
+// @param time_ms[in]               Time at the end of the hop
+// @param priorBeatLength_ms[in]    Expected beat length, 0 for no preference
+// @param estimate[out]             Latest tempo, confidence and predicted next beat
+void TempoTrackerUpdate(float onsetStrength, int64_t time_ms, uint16_t priorBeatLength_ms, tempoEstimate_t *estimate);
+
+#endif // TEMPO_TRACKER_H
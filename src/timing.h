@@ -3,6 +3,31 @@
 
 #include <Arduino.h>
 
+#ifdef NATIVE_BUILD
+#include "native_hal.h"
+
+// Get the current number of micros of audio consumed, see native_hal.h
+inline int64_t GetMicros(void)
+{
+    return NativeClockMicros();
+}
+
+// Host nanoseconds stand in for the cycle counter, the simulated clock is no use for timing code
+inline uint32_t GetCycleCount(void)
+{
+    return NativeCycleCount();
+}
+
+inline uint16_t GetCyclesPerMicro(void)
+{
+    return 1000;
+}
+
+inline uint32_t GetCoreId(void)
+{
+    return 0;
+}
+#else
 // Get the current number of micros since power on, from the ESP's hardware timer.
 // This would wrap after (2^64) / (10^6 * 60 * 60 * 24 * 365) = 584942 years
 inline int64_t GetMicros(void)
@@ -10,6 +35,23 @@ inline int64_t GetMicros(void)
     return esp_timer_get_time();
 }
 
+// Cycle counter of the calling core, a single register read. Wraps every 2^32 cycles.
+inline uint32_t GetCycleCount(void)
+{
+    return ESP.getCycleCount();
+}
+
+inline uint16_t GetCyclesPerMicro(void)
+{
+    return ESP.getCpuFreqMHz();
+}
+
+inline uint32_t GetCoreId(void)
+{
+    return xPortGetCoreID();
+}
+#endif // NATIVE_BUILD
+
 // Get the current number of millis since power on, from the ESP's hardware timer.
 inline int64_t GetMillis(void)
 {
@@ -0,0 +1,57 @@
+#ifndef TRACE_FORMAT_H
+#define TRACE_FORMAT_H
+
+#include <stdint.h>
+
+// Wire format of the trace recorder in profiling.h, shared with the host decoder in
+// src/native/trace_decode. A dump is one block per core, each a traceDumpHeader_t followed
+// by recordCount traceRecord_t, oldest first, in the ESP32's little endian layout.
+
+#define TRACE_DUMP_MAGIC "LHTR"
+#define TRACE_FORMAT_VERSION 1
+
+enum class TraceStage : uint8_t
+{
+    mic_read,
+    fft,
+    bands,
+    detect,
+    effect,
+    show,
+    frame,
+    beat,
+    output,
+    stage_count,
+};
+
+static const char *const traceStageNames[] = {"mic_read", "fft", "bands", "detect", "effect", "show", "frame", "beat", "output"};
+static_assert(sizeof(traceStageNames) / sizeof(traceStageNames[0]) == (uint32_t)TraceStage::stage_count, "Name every trace stage");
+
+enum class TracePhase : uint8_t
+{
+    begin,
+    end,
+    instant,
+};
+
+typedef struct traceRecord_t
+{
+    uint32_t timestamp_cycles; // Cycle counter of the core that recorded it, wraps
+    TraceStage stage;
+    TracePhase phase;
+    uint16_t arg;
+} traceRecord_s;
+static_assert(sizeof(traceRecord_t) == 8, "Trace records must stay 8 bytes");
+
+typedef struct traceDumpHeader_t
+{
+    char magic[4];
+    uint8_t version;
+    uint8_t core;
+    uint16_t cyclesPerMicro;
+    uint32_t recordCount;
+    uint32_t droppedCount; // Records overwritten before they could be dumped
+} traceDumpHeader_s;
+static_assert(sizeof(traceDumpHeader_t) == 16, "Trace dump header must stay 16 bytes");
+
+#endif // TRACE_FORMAT_H
@@ -0,0 +1,46 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <stdint.h>
+
+// Wait-free mailbox holding the latest value written by one task for one other task to read.
+// The writer fills its back slot and swaps it with the middle slot, the reader swaps the middle
+// slot with its front slot only when the writer has marked it fresh. Neither side ever waits or
+// retries, a value written twice before a read is simply replaced.
+template <typename T>
+class TripleBuffer
+{
+public:
+    // Writer only.
+    void Write(const T &item)
+    {
+        slots[backIndex] = item;
+        const uint8_t previousMiddle = middle.exchange(backIndex | FRESH_BIT, std::memory_order_acq_rel);
+        backIndex = previousMiddle & INDEX_MASK;
+    }
+
+    // Reader only. Returns false and leaves item untouched if nothing was written since the last read.
+    bool Read(T *item)
+    {
+        if ((middle.load(std::memory_order_relaxed) & FRESH_BIT) == 0)
+        {
+            return false;
+        }
+        const uint8_t previousMiddle = middle.exchange(frontIndex, std::memory_order_acq_rel);
+        frontIndex = previousMiddle & INDEX_MASK;
+        *item = slots[frontIndex];
+        return true;
+    }
+
+private:
+    static constexpr uint8_t INDEX_MASK = 0x03;
+    static constexpr uint8_t FRESH_BIT = 0x04;
+
+    T slots[3];
+    uint8_t backIndex = 0;  // Writer owned
+    uint8_t frontIndex = 1; // Reader owned
+    std::atomic<uint8_t> middle{2};
+};
+
+#endif // TRIPLE_BUFFER_H